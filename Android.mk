@@ -29,6 +29,7 @@ rockchip_drivers := rockchip
 nouveau_drivers := nouveau
 vmwgfx_drivers := vmwgfx
 vc4_drivers := vc4 v3d
+dumb_drivers := dumb
 
 valid_drivers := \
 	prebuilt \
@@ -37,7 +38,8 @@ valid_drivers := \
 	$(rockchip_drivers) \
 	$(nouveau_drivers) \
 	$(vmwgfx_drivers) \
-        $(vc4_drivers)
+        $(vc4_drivers) \
+	$(dumb_drivers)
 
 # warn about invalid drivers
 invalid_drivers := $(filter-out $(valid_drivers), $(DRM_GPU_DRIVERS))
@@ -87,7 +89,15 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_PROPRIETARY_MODULE := true
 
 LOCAL_SRC_FILES := \
-	gralloc_drm.c
+	gralloc_drm.c \
+	gralloc_drm_dumb.c \
+	gralloc_drm_formats.c \
+	gralloc_drm_heap.c \
+	gralloc_drm_leak.c \
+	gralloc_drm_mutex.c \
+	gralloc_drm_stall.c \
+	gralloc_drm_stats.c \
+	gralloc_drm_timeline.c
 
 LOCAL_C_INCLUDES := \
 	hardware/libhardware/include \
@@ -95,14 +105,22 @@ LOCAL_C_INCLUDES := \
 	external/libdrm/include/drm
 
 LOCAL_SHARED_LIBRARIES := \
+	libdl \
 	libdrm \
 	liblog \
 	libcutils \
 	libutils \
+	libsync \
         libz
 
 LOCAL_STATIC_LIBRARIES += libexpat
 
+# the fallback for KMS devices without a driver of their own
+LOCAL_CFLAGS += -DENABLE_DUMB
+
+# dma-buf heaps for bos the GPU does not use
+LOCAL_CFLAGS += -DENABLE_HEAP
+
 ifneq ($(filter $(intel_drivers), $(DRM_GPU_DRIVERS)),)
 LOCAL_SRC_FILES += gralloc_drm_intel.c
 LOCAL_C_INCLUDES += external/libdrm/intel
@@ -203,6 +221,7 @@ LOCAL_C_INCLUDES := \
 LOCAL_SHARED_LIBRARIES := \
 	libgralloc_drm \
 	liblog \
+	libcutils \
 	libutils
 
 # for glFlush/glFinish
@@ -220,5 +239,7 @@ LOCAL_CFLAGS += \
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(LOCAL_PATH)/tools/Android.mk
+
 endif # DRM_GPU_DRIVERS=prebuilt
 endif # DRM_GPU_DRIVERS
@@ -24,33 +24,165 @@
 #define LOG_TAG "GRALLOC-MOD"
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include "gralloc_drm.h"
 #include "gralloc_drm_priv.h"
+#include "gralloc_drm_record.h"
+
+static int drm_mod_record_fd = -1;
+static int64_t drm_mod_record_start;
+
+/*
+ * Start recording the calls to a trace file when gralloc.drm.record is
+ * set.  Called once.
+ */
+static void drm_mod_record_init(void)
+{
+	char path[PROPERTY_VALUE_MAX], name[PROPERTY_VALUE_MAX + 16];
+	struct gralloc_drm_record_header header;
+	int fd;
+
+	property_get("gralloc.drm.record", path, "");
+	if (!path[0])
+		return;
+
+	snprintf(name, sizeof(name), "%s.%d", path, getpid());
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+			0644);
+	if (fd < 0) {
+		ALOGE("failed to open trace file %s", name);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = GRALLOC_DRM_RECORD_MAGIC;
+	header.version = GRALLOC_DRM_RECORD_VERSION;
+	header.record_size = sizeof(struct gralloc_drm_record);
+	header.pid = getpid();
+	header.start_time = gralloc_drm_get_time();
+
+	if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+		ALOGE("failed to write trace file %s", name);
+		close(fd);
+		return;
+	}
+
+	drm_mod_record_start = header.start_time;
+	__atomic_store_n(&drm_mod_record_fd, fd, __ATOMIC_RELEASE);
+
+	ALOGI("recording gralloc calls to %s", name);
+}
+
+/*
+ * Return the time a call starts when recording, or 0.
+ */
+static inline int64_t drm_mod_record_begin(void)
+{
+	if (__atomic_load_n(&drm_mod_record_fd, __ATOMIC_ACQUIRE) < 0)
+		return 0;
+
+	return gralloc_drm_get_time();
+}
+
+/*
+ * Record a call on a buffer that started at start.  bo identifies the
+ * buffer and handle describes it; either may be NULL.
+ */
+static void drm_mod_record_end(int op, int64_t start,
+		const struct gralloc_drm_bo_t *bo,
+		const struct gralloc_drm_handle_t *handle, int usage,
+		int x, int y, int w, int h, int err)
+{
+	struct gralloc_drm_record rec;
+	int64_t duration;
+
+	if (!start)
+		return;
+
+	duration = gralloc_drm_get_time() - start;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time = start - drm_mod_record_start;
+	rec.buffer = (uint64_t) (uintptr_t) bo;
+	rec.duration = (duration > UINT32_MAX) ? UINT32_MAX : duration;
+	rec.tid = gettid();
+	rec.op = op;
+	rec.err = err;
+	if (handle) {
+		rec.width = handle->width;
+		rec.height = handle->height;
+		rec.format = handle->format;
+		rec.usage = handle->usage;
+	}
+	if (op == GRALLOC_DRM_RECORD_LOCK ||
+	    op == GRALLOC_DRM_RECORD_LOCK_YCBCR) {
+		rec.usage = usage;
+		rec.x = x;
+		rec.y = y;
+		rec.w = w;
+		rec.h = h;
+	}
+
+	/* appends of a record are atomic */
+	if (write(drm_mod_record_fd, &rec, sizeof(rec)) != sizeof(rec))
+		ALOGE("failed to record gralloc call");
+}
 
 /*
  * Initialize the DRM device object
  */
 static int drm_init(struct drm_module_t *dmod)
 {
+	struct gralloc_drm_t *drm;
 	int err = 0;
 
-	pthread_mutex_lock(&dmod->mutex);
+	/* skip the mutex once initialized */
+	if (__atomic_load_n(&dmod->drm, __ATOMIC_ACQUIRE))
+		return 0;
+
+	gralloc_drm_mutex_lock(&dmod->mutex);
 	if (!dmod->drm) {
-		dmod->drm = gralloc_drm_create();
-		if (!dmod->drm)
+		drm = gralloc_drm_create();
+		if (drm) {
+			drm_mod_record_init();
+			__atomic_store_n(&dmod->drm, drm, __ATOMIC_RELEASE);
+		}
+		else {
 			err = -EINVAL;
+		}
 	}
-	pthread_mutex_unlock(&dmod->mutex);
+	gralloc_drm_mutex_unlock(&dmod->mutex);
 
 	return err;
 }
 
+/*
+ * Describe the state of gralloc in buf, for dumpsys.
+ */
+static int drm_mod_dump(struct drm_module_t *dmod, char *buf, int len)
+{
+	int pos;
+
+	pos = gralloc_drm_dump_stats(dmod->drm, buf, len);
+	if (pos < 0)
+		return pos;
+
+	if (pos < len - 1)
+		pos += gralloc_drm_dump_stalls(dmod->drm, buf + pos, len - pos);
+	if (pos < len - 1)
+		gralloc_drm_dump_lock_stats(buf + pos, len - pos);
+
+	return 0;
+}
+
 static int drm_mod_perform(const struct gralloc_module_t *mod, int op, ...)
 {
 	struct drm_module_t *dmod = (struct drm_module_t *) mod;
@@ -70,6 +202,66 @@ static int drm_mod_perform(const struct gralloc_module_t *mod, int op, ...)
 			err = 0;
 		}
 		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_FLUSH):
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_INVALIDATE):
+		{
+			buffer_handle_t handle = va_arg(args, buffer_handle_t);
+			struct gralloc_drm_bo_t *bo;
+
+			bo = gralloc_drm_bo_from_handle(handle);
+			if (bo)
+				err = gralloc_drm_bo_sync_cpu(bo,
+					op == static_cast<int>(GRALLOC_MODULE_PERFORM_FLUSH));
+			else
+				err = -EINVAL;
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_GET_STATS):
+		{
+			struct gralloc_drm_stats *stats =
+				va_arg(args, struct gralloc_drm_stats *);
+			gralloc_drm_get_stats(dmod->drm, stats);
+			err = 0;
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_DUMP):
+		{
+			char *buf = va_arg(args, char *);
+			int len = va_arg(args, int);
+			err = drm_mod_dump(dmod, buf, len);
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_FLUSH_TIMELINE):
+		{
+			const char *path = va_arg(args, const char *);
+			err = gralloc_drm_timeline_flush(path);
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_GET_STALLS):
+		{
+			struct gralloc_drm_stall *stalls =
+				va_arg(args, struct gralloc_drm_stall *);
+			int *count = va_arg(args, int *);
+			err = gralloc_drm_get_stalls(dmod->drm, stalls, count);
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_GET_LOCK_STATS):
+		{
+			struct gralloc_drm_lock_stats *stats =
+				va_arg(args, struct gralloc_drm_lock_stats *);
+			int *count = va_arg(args, int *);
+			err = gralloc_drm_get_lock_stats(stats, count);
+		}
+		break;
+	case static_cast<int>(GRALLOC_MODULE_PERFORM_DUMP_BUFFERS):
+		{
+			char *buf = va_arg(args, char *);
+			int len = va_arg(args, int);
+			err = gralloc_drm_dump_buffers(dmod->drm, buf, len);
+			if (err > 0)
+				err = 0;
+		}
+		break;
 	default:
 		err = -EINVAL;
 		break;
@@ -83,24 +275,44 @@ static int drm_mod_register_buffer(const gralloc_module_t *mod,
 		buffer_handle_t handle)
 {
 	struct drm_module_t *dmod = (struct drm_module_t *) mod;
+	int64_t start;
 	int err;
 
 	err = drm_init(dmod);
 	if (err)
 		return err;
 
-	return gralloc_drm_handle_register(handle, dmod->drm);
+	start = drm_mod_record_begin();
+	err = gralloc_drm_handle_register(handle, dmod->drm);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_REGISTER, start,
+			gralloc_drm_bo_from_handle(handle),
+			gralloc_drm_handle(handle), 0, 0, 0, 0, 0, err);
+
+	return err;
 }
 
 static int drm_mod_unregister_buffer(const gralloc_module_t *mod,
 		buffer_handle_t handle)
 {
-	return gralloc_drm_handle_unregister(handle);
+	int64_t start = drm_mod_record_begin();
+	struct gralloc_drm_bo_t *bo = NULL;
+	int err;
+
+	/* the bo may be gone after the call, only its address is recorded */
+	if (start)
+		bo = gralloc_drm_bo_from_handle(handle);
+
+	err = gralloc_drm_handle_unregister(handle);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_UNREGISTER, start, bo,
+			gralloc_drm_handle(handle), 0, 0, 0, 0, 0, err);
+
+	return err;
 }
 
 static int drm_mod_lock(const gralloc_module_t *mod, buffer_handle_t handle,
 		int usage, int x, int y, int w, int h, void **ptr)
 {
+	int64_t start = drm_mod_record_begin();
 	struct gralloc_drm_bo_t *bo;
 	int err;
 
@@ -108,59 +320,103 @@ static int drm_mod_lock(const gralloc_module_t *mod, buffer_handle_t handle,
 	if (!bo)
 		return -EINVAL;
 
-	return gralloc_drm_bo_lock(bo, usage, x, y, w, h, ptr);
+	err = gralloc_drm_bo_lock(bo, usage, x, y, w, h, ptr);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_LOCK, start, bo, bo->handle,
+			usage, x, y, w, h, err);
+
+	return err;
 }
 
 static int drm_mod_lock_ycbcr(const gralloc_module_t *mod, buffer_handle_t bhandle,
 		int usage, int x, int y, int w, int h, struct android_ycbcr *ycbcr)
 {
-	struct gralloc_drm_handle_t *handle;
+	int64_t start = drm_mod_record_begin();
 	struct gralloc_drm_bo_t *bo;
-	void *ptr;
 	int err;
 
 	bo = gralloc_drm_bo_from_handle(bhandle);
 	if (!bo)
 		return -EINVAL;
-	handle = bo->handle;
 
-	switch(handle->format) {
-	case HAL_PIXEL_FORMAT_YCbCr_420_888:
-		break;
-	default:
+	err = gralloc_drm_bo_lock_ycbcr(bo, usage, x, y, w, h, ycbcr);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_LOCK_YCBCR, start, bo, bo->handle,
+			usage, x, y, w, h, err);
+
+	return err;
+}
+
+static int drm_mod_unlock(const gralloc_module_t *mod, buffer_handle_t handle)
+{
+	struct drm_module_t *dmod = (struct drm_module_t *) mod;
+	int64_t start = drm_mod_record_begin();
+	struct gralloc_drm_bo_t *bo;
+
+	bo = gralloc_drm_bo_from_handle(handle);
+	if (!bo)
+		return -EINVAL;
+
+	gralloc_drm_bo_unlock(bo);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_UNLOCK, start, bo, bo->handle,
+			0, 0, 0, 0, 0, 0);
+
+	return 0;
+}
+
+static int drm_mod_lock_async(const gralloc_module_t *mod,
+		buffer_handle_t handle, int usage, int x, int y, int w, int h,
+		void **ptr, int fence_fd)
+{
+	struct gralloc_drm_bo_t *bo;
+	int err;
+
+	bo = gralloc_drm_bo_from_handle(handle);
+	if (!bo) {
+		if (fence_fd >= 0)
+			close(fence_fd);
 		return -EINVAL;
 	}
 
-	err = gralloc_drm_bo_lock(bo, usage, x, y, w, h, &ptr);
+	err = gralloc_drm_bo_wait_fence(bo, usage, fence_fd);
 	if (err)
 		return err;
 
-	switch(handle->format) {
-	case HAL_PIXEL_FORMAT_YCbCr_420_888:
-		ycbcr->y = ptr;
-		ycbcr->cb = (uint8_t *)ptr + handle->stride * handle->height;
-		ycbcr->cr = (uint8_t *)ycbcr->cb + 1;
-		ycbcr->ystride = handle->stride;
-		ycbcr->cstride = handle->stride;
-		ycbcr->chroma_step = 2;
-		break;
-	default:
-		break;
+	return drm_mod_lock(mod, handle, usage, x, y, w, h, ptr);
+}
+
+static int drm_mod_lock_async_ycbcr(const gralloc_module_t *mod,
+		buffer_handle_t handle, int usage, int x, int y, int w, int h,
+		struct android_ycbcr *ycbcr, int fence_fd)
+{
+	struct gralloc_drm_bo_t *bo;
+	int err;
+
+	bo = gralloc_drm_bo_from_handle(handle);
+	if (!bo) {
+		if (fence_fd >= 0)
+			close(fence_fd);
+		return -EINVAL;
 	}
 
-	return 0;
+	err = gralloc_drm_bo_wait_fence(bo, usage, fence_fd);
+	if (err)
+		return err;
+
+	return drm_mod_lock_ycbcr(mod, handle, usage, x, y, w, h, ycbcr);
 }
 
-static int drm_mod_unlock(const gralloc_module_t *mod, buffer_handle_t handle)
+static int drm_mod_unlock_async(const gralloc_module_t *mod,
+		buffer_handle_t handle, int *fence_fd)
 {
-	struct drm_module_t *dmod = (struct drm_module_t *) mod;
+	int64_t start = drm_mod_record_begin();
 	struct gralloc_drm_bo_t *bo;
 
 	bo = gralloc_drm_bo_from_handle(handle);
 	if (!bo)
 		return -EINVAL;
 
-	gralloc_drm_bo_unlock(bo);
+	gralloc_drm_bo_unlock_async(bo, fence_fd);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_UNLOCK, start, bo, bo->handle,
+			0, 0, 0, 0, 0, 0);
 
 	return 0;
 }
@@ -179,33 +435,65 @@ static int drm_mod_close_gpu0(struct hw_device_t *dev)
 static int drm_mod_free_gpu0(alloc_device_t *dev, buffer_handle_t handle)
 {
 	struct drm_module_t *dmod = (struct drm_module_t *) dev->common.module;
+	int64_t start = drm_mod_record_begin();
+	struct gralloc_drm_handle_t saved;
 	struct gralloc_drm_bo_t *bo;
 
 	bo = gralloc_drm_bo_from_handle(handle);
 	if (!bo)
 		return -EINVAL;
 
+	/* the handle goes away with the bo */
+	if (start)
+		saved = *bo->handle;
+
 	gralloc_drm_bo_decref(bo);
+	drm_mod_record_end(GRALLOC_DRM_RECORD_FREE, start, bo, &saved,
+			0, 0, 0, 0, 0, 0);
 
 	return 0;
 }
 
+static void drm_mod_dump_gpu0(alloc_device_t *dev, char *buf, int len)
+{
+	struct drm_module_t *dmod = (struct drm_module_t *) dev->common.module;
+
+	drm_mod_dump(dmod, buf, len);
+}
+
 static int drm_mod_alloc_gpu0(alloc_device_t *dev,
 		int w, int h, int format, int usage,
 		buffer_handle_t *handle, int *stride)
 {
 	struct drm_module_t *dmod = (struct drm_module_t *) dev->common.module;
+	int64_t start = drm_mod_record_begin();
 	struct gralloc_drm_bo_t *bo;
 	int size, bpp, err;
 
-	bpp = gralloc_drm_get_bpp(format);
+	bpp = gralloc_drm_get_bpp(gralloc_drm_get_alloc_format(format, usage));
 	if (!bpp)
 		return -EINVAL;
 
 	bo = gralloc_drm_bo_create(dmod->drm, w, h, format, usage);
+	if (start) {
+		struct gralloc_drm_handle_t req;
+
+		/* failures are recorded with the requested geometry */
+		memset(&req, 0, sizeof(req));
+		req.width = w;
+		req.height = h;
+		req.format = format;
+		req.usage = usage;
+		drm_mod_record_end(GRALLOC_DRM_RECORD_ALLOC, start, bo,
+				(bo) ? bo->handle : &req, 0, 0, 0, 0, 0,
+				(bo) ? 0 : -ENOMEM);
+	}
 	if (!bo)
 		return -ENOMEM;
 
+	/* the client may pass the handle to other processes */
+	gralloc_drm_bo_export(bo);
+
 	*handle = gralloc_drm_bo_get_handle(bo, stride);
 	/* in pixels */
 	*stride /= bpp;
@@ -233,6 +521,7 @@ static int drm_mod_open_gpu0(struct drm_module_t *dmod, hw_device_t **dev)
 
 	alloc->alloc = drm_mod_alloc_gpu0;
 	alloc->free = drm_mod_free_gpu0;
+	alloc->dump = drm_mod_dump_gpu0;
 
 	*dev = &alloc->common;
 
@@ -261,8 +550,9 @@ struct drm_module_t HAL_MODULE_INFO_SYM = {
 	.base = {
 		.common = {
 			.tag = HARDWARE_MODULE_TAG,
-			.version_major = 1,
-			.version_minor = 0,
+			/* 0.3 for lockAsync and unlockAsync */
+			.module_api_version = GRALLOC_MODULE_API_VERSION_0_3,
+			.hal_api_version = HARDWARE_HAL_API_VERSION,
 			.id = GRALLOC_HARDWARE_MODULE_ID,
 			.name = "DRM Memory Allocator",
 			.author = "Chia-I Wu",
@@ -274,8 +564,11 @@ struct drm_module_t HAL_MODULE_INFO_SYM = {
 		.unlock = drm_mod_unlock,
 		.perform = drm_mod_perform,
 		.lock_ycbcr = drm_mod_lock_ycbcr,
+		.lockAsync = drm_mod_lock_async,
+		.unlockAsync = drm_mod_unlock_async,
+		.lockAsync_ycbcr = drm_mod_lock_async_ycbcr,
 	},
 
-	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.mutex = GRALLOC_DRM_MUTEX_INITIALIZER("module"),
 	.drm = NULL
 };
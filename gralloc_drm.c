@@ -26,17 +26,29 @@
 #include <log/log.h>
 #include <cutils/atomic.h>
 #include <cutils/properties.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <sync/sync.h>
+#include <drm_fourcc.h>
 
 #include "gralloc_drm.h"
 #include "gralloc_drm_priv.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define likely(x) __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
 static int32_t gralloc_drm_pid = 0;
@@ -88,6 +100,14 @@ init_drv_from_fd(int fd, int kms_fd)
 #ifdef ENABLE_NOUVEAU
 		if (!drv && !strcmp(version->name, "nouveau"))
 			drv = gralloc_drm_drv_create_for_nouveau(fd);
+#endif
+#ifdef ENABLE_DUMB
+		/* any KMS device can do dumb buffers */
+		if (!drv) {
+			drv = gralloc_drm_drv_create_for_dumb(fd);
+			if (drv)
+				ALOGI("using dumb buffers for %s", version->name);
+		}
 #endif
 	}
 
@@ -101,6 +121,695 @@ init_drv_from_fd(int fd, int kms_fd)
 	return drv;
 }
 
+#ifdef ENABLE_HEAP
+/*
+ * Create the driver for dma-buf heaps.  When the heaps are disabled or
+ * missing, it only imports the bos that other processes allocated from
+ * them.
+ */
+static void gralloc_drm_heap_init(struct gralloc_drm_t *drm)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	property_get("gralloc.drm.heap", value, "1");
+	if (atoi(value))
+		drm->heap = gralloc_drm_drv_create_for_heap(1);
+
+	drm->heap_alloc = (drm->heap != NULL);
+	if (!drm->heap)
+		drm->heap = gralloc_drm_drv_create_for_heap(0);
+}
+#endif
+
+/*
+ * Return the driver of a handle.  Buffers that neither the GPU nor the
+ * display accesses are allocated from dma-buf heaps when available, and
+ * the handle records it for the importers.  Without a heap driver, the
+ * GPU driver imports them through their prime fds.
+ */
+static struct gralloc_drm_drv_t *gralloc_drm_get_drv(
+		struct gralloc_drm_t *drm, struct gralloc_drm_handle_t *handle)
+{
+	return (handle->heap && drm->heap) ? drm->heap : drm->drv;
+}
+
+/*
+ * Return true if a new bo should be allocated from a dma-buf heap.
+ */
+static int gralloc_drm_uses_heap(struct gralloc_drm_t *drm, int usage)
+{
+	return (drm->heap_alloc &&
+		!(usage & (GRALLOC_USAGE_HW_TEXTURE |
+			   GRALLOC_USAGE_HW_RENDER |
+			   GRALLOC_USAGE_HW_2D |
+			   GRALLOC_USAGE_HW_COMPOSER |
+			   GRALLOC_USAGE_HW_FB |
+			   GRALLOC_USAGE_PROTECTED)));
+}
+
+/*
+ * Read the limit of the kept mappings.
+ */
+static void gralloc_drm_map_init(struct gralloc_drm_t *drm)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	gralloc_drm_mutex_init(&drm->map_mutex, "map");
+
+	/* in MiB; a zero size disables kept mappings */
+	property_get("gralloc.drm.map_cache_mb", value, "128");
+	drm->map_max_bytes = (size_t) atoi(value) * 1024 * 1024;
+
+	/* cached mappings need DMA_BUF_IOCTL_SYNC, which is Linux 4.6+ */
+	property_get("gralloc.drm.dmabuf_map", value, "0");
+	drm->dmabuf_map = atoi(value);
+}
+
+/*
+ * Start or end CPU access to a dma-buf mapped cached.
+ */
+int gralloc_drm_dmabuf_sync(int fd, uint64_t flags)
+{
+	struct dma_buf_sync sync;
+	int ret;
+
+	memset(&sync, 0, sizeof(sync));
+	sync.flags = flags;
+	gralloc_drm_timeline_begin("dmabuf_sync");
+	do {
+		ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret && (errno == EINTR || errno == EAGAIN));
+	gralloc_drm_timeline_end("dmabuf_sync");
+
+	if (ret) {
+		ret = -errno;
+		ALOGE("failed to sync dma-buf %d: %d", fd, ret);
+	}
+
+	return ret;
+}
+
+/*
+ * Return the number of references to the file of a dma-buf, or -1 when
+ * the kernel does not report it in fdinfo.
+ */
+static long gralloc_drm_dmabuf_get_count(int fd)
+{
+	char path[64], line[128];
+	long count = -1;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+	fp = fopen(path, "re");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "count: %ld", &count) == 1)
+			break;
+	}
+
+	fclose(fp);
+
+	return count;
+}
+
+/*
+ * Mark a bo as handed to a client, which may pass its handle on to other
+ * processes.  The references to its dma-buf are counted before any of
+ * them can exist.
+ */
+void gralloc_drm_bo_export(struct gralloc_drm_bo_t *bo)
+{
+	bo->exported = 1;
+	bo->export_count = (bo->handle->prime_fd >= 0) ?
+		gralloc_drm_dmabuf_get_count(bo->handle->prime_fd) : -1;
+}
+
+/*
+ * Return true if another process may still hold an exported bo.  Every
+ * process that imports or maps the dma-buf, or has its fd in flight,
+ * holds a reference to its file.  The importers of gralloc_drm use the
+ * prime fd when there is one; a bo shared by its name alone cannot be
+ * tracked.  The mappings of this process must be released.
+ */
+static int gralloc_drm_bo_is_shared(struct gralloc_drm_bo_t *bo)
+{
+	long count;
+
+	if (!bo->exported)
+		return 0;
+
+	if (bo->handle->prime_fd < 0 || bo->export_count < 0)
+		return 1;
+
+	count = gralloc_drm_dmabuf_get_count(bo->handle->prime_fd);
+
+	return (count < 0 || count > bo->export_count);
+}
+
+/*
+ * Remove a bo from the list of kept mappings and unmap it.  The map mutex
+ * must be held.
+ */
+static void gralloc_drm_map_drop_locked(struct gralloc_drm_t *drm,
+		struct gralloc_drm_bo_t *bo)
+{
+	if (bo->map_prev)
+		bo->map_prev->map_next = bo->map_next;
+	else
+		drm->map_head = bo->map_next;
+
+	if (bo->map_next)
+		bo->map_next->map_prev = bo->map_prev;
+	else
+		drm->map_tail = bo->map_prev;
+
+	bo->map_prev = NULL;
+	bo->map_next = NULL;
+	drm->map_bytes -= bo->size;
+
+	bo->map_kept = 0;
+	gralloc_drm_timeline_begin("unmap");
+	if (bo->dmabuf_mapped) {
+		munmap(bo->map_addr, bo->size);
+		bo->dmabuf_mapped = 0;
+	}
+	else {
+		bo->drv->unmap(bo->drv, bo);
+	}
+	gralloc_drm_timeline_end("unmap");
+}
+
+/*
+ * Keep the mapping of a bo that has just been mapped.  When the kept
+ * mappings use too much address space, the unlocked ones are unmapped,
+ * oldest first.  The lock mutex of the bo must be held.
+ */
+static void gralloc_drm_map_keep(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_t *drm = bo->drm;
+	struct gralloc_drm_bo_t *iter, *next;
+
+	gralloc_drm_mutex_lock(&drm->map_mutex);
+
+	bo->map_kept = 1;
+	bo->map_next = NULL;
+	bo->map_prev = drm->map_tail;
+	if (drm->map_tail)
+		drm->map_tail->map_next = bo;
+	else
+		drm->map_head = bo;
+	drm->map_tail = bo;
+	drm->map_bytes += bo->size;
+
+	for (iter = drm->map_head; iter && drm->map_bytes > drm->map_max_bytes;
+	     iter = next) {
+		next = iter->map_next;
+
+		/* the lock order is bo first, so do not wait */
+		if (iter == bo || pthread_mutex_trylock(&iter->lock_mutex))
+			continue;
+
+		if (!android_atomic_acquire_load(&iter->lock_state))
+			gralloc_drm_map_drop_locked(drm, iter);
+
+		pthread_mutex_unlock(&iter->lock_mutex);
+	}
+
+	gralloc_drm_mutex_unlock(&drm->map_mutex);
+}
+
+/*
+ * Tear down the kept mapping of a bo that is no longer used.
+ */
+static void gralloc_drm_map_release(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_t *drm = bo->drm;
+
+	if (!bo->map_kept)
+		return;
+
+	gralloc_drm_mutex_lock(&drm->map_mutex);
+	if (bo->map_kept)
+		gralloc_drm_map_drop_locked(drm, bo);
+	gralloc_drm_mutex_unlock(&drm->map_mutex);
+}
+
+/*
+ * Free a bo through its driver.
+ */
+static void gralloc_drm_bo_free(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_drv_t *drv = bo->drv;
+
+	gralloc_drm_map_release(bo);
+	pthread_mutex_destroy(&bo->lock_mutex);
+	drv->free(drv, bo);
+}
+
+/*
+ * Return true if the layout of a bo is linear or implied by its handle.
+ */
+static int gralloc_drm_bo_is_linear(struct gralloc_drm_bo_t *bo)
+{
+	return (bo->handle->modifier == DRM_FORMAT_MOD_INVALID ||
+		bo->handle->modifier == DRM_FORMAT_MOD_LINEAR);
+}
+
+/*
+ * Zero-fill memory.  Non-temporal stores are used where available so that
+ * clearing large buffers does not evict the working set of other threads.
+ */
+static void gralloc_drm_zero(void *dst, size_t size)
+{
+#if defined(__SSE2__)
+	uint8_t *ptr = (uint8_t *) dst;
+
+	if (!((uintptr_t) ptr & 15)) {
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; size >= 64; ptr += 64, size -= 64) {
+			_mm_stream_si128((__m128i *) ptr, zero);
+			_mm_stream_si128((__m128i *) (ptr + 16), zero);
+			_mm_stream_si128((__m128i *) (ptr + 32), zero);
+			_mm_stream_si128((__m128i *) (ptr + 48), zero);
+		}
+		_mm_sfence();
+	}
+
+	memset(ptr, 0, size);
+#else
+	memset(dst, 0, size);
+#endif
+}
+
+/*
+ * Clear a bo so that stale data do not leak to its new owner.
+ */
+static int gralloc_drm_bo_clear(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_drv_t *drv = bo->drv;
+	struct gralloc_drm_handle_t *handle = bo->handle;
+	struct gralloc_drm_layout layout;
+	size_t size;
+	void *addr;
+	int rows, err;
+
+	gralloc_drm_timeline_begin("clear");
+
+	if (drv->clear) {
+		err = drv->clear(drv, bo);
+		goto out;
+	}
+
+	/* the chroma planes of planar formats are extra rows */
+	rows = handle->height;
+	if (gralloc_drm_get_layout(handle->format, handle->height,
+				handle->stride, &layout) > 1)
+		rows = layout.rows;
+
+	/*
+	 * the mapping covers the whole bo, including the padding of tiled
+	 * layouts past the last row
+	 */
+	size = (bo->size) ? bo->size : (size_t) handle->stride * rows;
+
+	err = drv->map(drv, bo, 0, 0, handle->width, rows, 1, &addr);
+	if (!err) {
+		gralloc_drm_zero(addr, size);
+		drv->unmap(drv, bo);
+	}
+
+out:
+	if (!err)
+		bo->needs_clear = 0;
+
+	gralloc_drm_timeline_end("clear");
+
+	return err;
+}
+
+/*
+ * Read the limits of the bo cache.
+ */
+static void gralloc_drm_cache_init(struct gralloc_drm_t *drm)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	gralloc_drm_mutex_init(&drm->cache_mutex, "cache");
+
+	/*
+	 * in MiB and ms; a zero size disables the cache.  Exported bos are
+	 * cached only once no other process holds them, see
+	 * gralloc_drm_bo_is_shared.
+	 */
+	property_get("gralloc.drm.cache_mb", value, "32");
+	drm->cache_max_bytes = (size_t) atoi(value) * 1024 * 1024;
+	property_get("gralloc.drm.cache_ms", value, "2000");
+	drm->cache_max_age = (int64_t) atoi(value) * 1000000;
+}
+
+/*
+ * Remove a bo from the cache.  The cache mutex must be held.
+ */
+static void gralloc_drm_cache_unlink_locked(struct gralloc_drm_t *drm,
+		struct gralloc_drm_bo_t *bo)
+{
+	if (bo->cache_prev)
+		bo->cache_prev->cache_next = bo->cache_next;
+	else
+		drm->cache_head = bo->cache_next;
+
+	if (bo->cache_next)
+		bo->cache_next->cache_prev = bo->cache_prev;
+	else
+		drm->cache_tail = bo->cache_prev;
+
+	bo->cache_prev = NULL;
+	bo->cache_next = NULL;
+	drm->cache_bytes -= bo->size;
+}
+
+/*
+ * Insert a bo into the cache, which is sorted by cache_time, newest first.
+ * The cache mutex must be held.
+ */
+static void gralloc_drm_cache_insert_locked(struct gralloc_drm_t *drm,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_bo_t *prev = NULL, *next = drm->cache_head;
+
+	while (next && next->cache_time > bo->cache_time) {
+		prev = next;
+		next = next->cache_next;
+	}
+
+	bo->cache_prev = prev;
+	bo->cache_next = next;
+	if (prev)
+		prev->cache_next = bo;
+	else
+		drm->cache_head = bo;
+	if (next)
+		next->cache_prev = bo;
+	else
+		drm->cache_tail = bo;
+	drm->cache_bytes += bo->size;
+}
+
+/*
+ * Remove the least recently freed bos that are too old or that do not fit
+ * in the cache.  They are returned as a list linked through cache_next so
+ * that they can be freed without holding the mutex.
+ */
+static struct gralloc_drm_bo_t *gralloc_drm_cache_evict_locked(
+		struct gralloc_drm_t *drm, int64_t now, size_t max_bytes)
+{
+	struct gralloc_drm_bo_t *list = NULL;
+
+	while (drm->cache_tail) {
+		struct gralloc_drm_bo_t *bo = drm->cache_tail;
+
+		if (drm->cache_bytes <= max_bytes &&
+		    now - bo->cache_time <= drm->cache_max_age)
+			break;
+
+		gralloc_drm_cache_unlink_locked(drm, bo);
+		bo->cache_next = list;
+		list = bo;
+	}
+
+	return list;
+}
+
+/*
+ * Free a list of bos returned by gralloc_drm_cache_evict_locked.
+ */
+static void gralloc_drm_cache_free_list(struct gralloc_drm_t *drm,
+		struct gralloc_drm_bo_t *list)
+{
+	while (list) {
+		struct gralloc_drm_bo_t *bo = list;
+		struct gralloc_drm_handle_t *handle = bo->handle;
+
+		list = bo->cache_next;
+
+		gralloc_drm_bo_free(bo);
+		free(handle);
+	}
+}
+
+/*
+ * Hand a locally created bo that is no longer referenced to the cache.
+ * Return 0 if the cache takes the ownership of the bo.
+ */
+static int gralloc_drm_cache_put(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_t *drm = bo->drm;
+	struct gralloc_drm_bo_t *evicted;
+	int64_t now;
+
+	/*
+	 * buffers that are scanned out or protected are never recycled,
+	 * nor those the CPU cannot clear
+	 */
+	if (!bo->size || bo->size > drm->cache_max_bytes ||
+	    (bo->handle->usage & (GRALLOC_USAGE_HW_FB |
+				  GRALLOC_USAGE_PROTECTED)) ||
+	    (!gralloc_drm_bo_is_linear(bo) && !bo->drv->tiled_mappable &&
+	     !bo->drv->clear))
+		return -EINVAL;
+
+	gralloc_drm_map_release(bo);
+
+	/* nor those other processes still hold */
+	if (gralloc_drm_bo_is_shared(bo))
+		return -EINVAL;
+
+	now = gralloc_drm_get_time();
+
+	gralloc_drm_mutex_lock(&drm->cache_mutex);
+
+	bo->cache_time = now;
+	bo->needs_clear = 1;
+	gralloc_drm_cache_insert_locked(drm, bo);
+
+	evicted = gralloc_drm_cache_evict_locked(drm, now,
+			drm->cache_max_bytes);
+
+	if (drm->clear_running)
+		pthread_cond_signal(&drm->clear_cond);
+
+	gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+	gralloc_drm_cache_free_list(drm, evicted);
+
+	return 0;
+}
+
+/*
+ * Move a cached bo over to a new handle with a different geometry.
+ */
+static int gralloc_drm_cache_redescribe(struct gralloc_drm_t *drm,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct gralloc_drm_handle_t *old = bo->handle;
+	int err;
+
+	/* the new handle takes over the name and the prime fd */
+	handle->name = old->name;
+	handle->prime_fd = old->prime_fd;
+
+	err = bo->drv->redescribe(bo->drv, bo, handle);
+	if (err) {
+		handle->name = 0;
+		handle->prime_fd = -1;
+		return err;
+	}
+
+	bo->handle = handle;
+	free(old);
+
+	return 0;
+}
+
+/*
+ * Take a cached bo for a new handle.  A bo with the same geometry, format
+ * and usage is returned as is, with its own handle.  Otherwise, a bo
+ * whose backing store is in the same size class is re-described for the
+ * new handle when the driver supports it.
+ *
+ * When the clear worker runs, only bos it has cleared are taken; a new bo
+ * is cheaper than clearing a dirty one on the allocation path.
+ */
+static struct gralloc_drm_bo_t *gralloc_drm_cache_get(
+		struct gralloc_drm_t *drm,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct gralloc_drm_bo_t *bo, *evicted;
+
+	if (!drm->cache_max_bytes)
+		return NULL;
+
+	gralloc_drm_mutex_lock(&drm->cache_mutex);
+
+	evicted = gralloc_drm_cache_evict_locked(drm,
+			gralloc_drm_get_time(), drm->cache_max_bytes);
+
+	for (bo = drm->cache_head; bo; bo = bo->cache_next) {
+		struct gralloc_drm_handle_t *old = bo->handle;
+
+		if (bo->needs_clear && drm->clear_running)
+			continue;
+
+		if (old->width == handle->width &&
+		    old->height == handle->height &&
+		    old->format == handle->format &&
+		    old->usage == handle->usage)
+			break;
+	}
+
+	if (!bo) {
+		for (bo = drm->cache_head; bo; bo = bo->cache_next) {
+			if (bo->needs_clear && drm->clear_running)
+				continue;
+
+			if (bo->drv->redescribe &&
+			    bo->handle->usage == handle->usage &&
+			    !gralloc_drm_cache_redescribe(drm, bo, handle))
+				break;
+		}
+	}
+
+	if (bo)
+		gralloc_drm_cache_unlink_locked(drm, bo);
+
+	gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+	gralloc_drm_cache_free_list(drm, evicted);
+
+	return bo;
+}
+
+/*
+ * Clear the cached bos, newest first, so that gralloc_drm_bo_create can
+ * reuse them without touching their memory.  A bo is taken out of the
+ * cache while it is cleared.
+ */
+static void *gralloc_drm_clear_worker(void *arg)
+{
+	struct gralloc_drm_t *drm = (struct gralloc_drm_t *) arg;
+
+	gralloc_drm_mutex_lock(&drm->cache_mutex);
+
+	while (!drm->clear_quit) {
+		struct gralloc_drm_bo_t *bo;
+		int err;
+
+		for (bo = drm->cache_head; bo; bo = bo->cache_next) {
+			if (bo->needs_clear)
+				break;
+		}
+
+		if (!bo) {
+			gralloc_drm_mutex_cond_wait(&drm->clear_cond,
+					&drm->cache_mutex);
+			continue;
+		}
+
+		gralloc_drm_cache_unlink_locked(drm, bo);
+		gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+		err = gralloc_drm_bo_clear(bo);
+		if (err) {
+			ALOGE("failed to clear cached bo: %d", err);
+			bo->cache_next = NULL;
+			gralloc_drm_cache_free_list(drm, bo);
+		}
+
+		gralloc_drm_mutex_lock(&drm->cache_mutex);
+		if (!err)
+			gralloc_drm_cache_insert_locked(drm, bo);
+	}
+
+	gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+	return NULL;
+}
+
+/*
+ * Start the clear worker.
+ */
+static void gralloc_drm_clear_init(struct gralloc_drm_t *drm)
+{
+	pthread_cond_init(&drm->clear_cond, NULL);
+
+	if (!drm->cache_max_bytes)
+		return;
+
+	if (pthread_create(&drm->clear_thread, NULL,
+				gralloc_drm_clear_worker, drm)) {
+		ALOGE("failed to create clear worker, clearing synchronously");
+		return;
+	}
+
+	drm->clear_running = 1;
+}
+
+/*
+ * Stop the clear worker.  The bo it clears, if any, is back in the cache
+ * when it returns.
+ */
+static void gralloc_drm_clear_fini(struct gralloc_drm_t *drm)
+{
+	if (drm->clear_running) {
+		gralloc_drm_mutex_lock(&drm->cache_mutex);
+		drm->clear_quit = 1;
+		pthread_cond_signal(&drm->clear_cond);
+		gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+		pthread_join(drm->clear_thread, NULL);
+		drm->clear_running = 0;
+	}
+
+	pthread_cond_destroy(&drm->clear_cond);
+}
+
+/*
+ * Free all cached bos.
+ */
+static void gralloc_drm_cache_fini(struct gralloc_drm_t *drm)
+{
+	struct gralloc_drm_bo_t *evicted;
+
+	gralloc_drm_clear_fini(drm);
+
+	gralloc_drm_mutex_lock(&drm->cache_mutex);
+	evicted = gralloc_drm_cache_evict_locked(drm,
+			gralloc_drm_get_time(), 0);
+	gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+	gralloc_drm_cache_free_list(drm, evicted);
+	gralloc_drm_mutex_destroy(&drm->cache_mutex);
+}
+
+/*
+ * Initialize the driver-independent parts of a DRM device object.
+ */
+static void gralloc_drm_init(struct gralloc_drm_t *drm)
+{
+	gralloc_drm_mutex_profile_init();
+	gralloc_drm_mutex_init(&drm->import_mutex, "import");
+	gralloc_drm_cache_init(drm);
+	gralloc_drm_clear_init(drm);
+	gralloc_drm_map_init(drm);
+	gralloc_drm_stall_init(drm);
+	gralloc_drm_leak_init(drm);
+	gralloc_drm_timeline_init();
+}
+
 /*
  * Create a DRM device object.
  */
@@ -116,6 +825,13 @@ struct gralloc_drm_t *gralloc_drm_create(void)
 
 	property_get("gralloc.drm.device", path, "/dev/dri/renderD128");
 	drm->fd = open(path, O_RDWR);
+#ifdef ENABLE_DUMB
+	/* KMS-only devices such as vkms have no render node */
+	if (drm->fd < 0) {
+		strcpy(path, "/dev/dri/card0");
+		drm->fd = open(path, O_RDWR);
+	}
+#endif
 	if (drm->fd < 0) {
 		ALOGE("failed to open %s", path);
 		return NULL;
@@ -140,6 +856,36 @@ struct gralloc_drm_t *gralloc_drm_create(void)
 		return NULL;
 	}
 
+#ifdef ENABLE_HEAP
+	gralloc_drm_heap_init(drm);
+#endif
+
+	gralloc_drm_init(drm);
+
+	return drm;
+}
+
+/*
+ * Create a DRM device object around a driver that needs no DRM device,
+ * such as a software one for benchmarks.  It takes the ownership of the
+ * driver.
+ */
+struct gralloc_drm_t *gralloc_drm_create_for_drv(struct gralloc_drm_drv_t *drv)
+{
+	struct gralloc_drm_t *drm;
+
+	drm = calloc(1, sizeof(*drm));
+	if (!drm) {
+		drv->destroy(drv);
+		return NULL;
+	}
+
+	drm->fd = -1;
+	drm->kms_fd = -1;
+	drm->drv = drv;
+
+	gralloc_drm_init(drm);
+
 	return drm;
 }
 
@@ -148,9 +894,21 @@ struct gralloc_drm_t *gralloc_drm_create(void)
  */
 void gralloc_drm_destroy(struct gralloc_drm_t *drm)
 {
+	/* what is left of the timeline */
+	if (gralloc_drm_timeline_enabled)
+		gralloc_drm_timeline_flush(NULL);
+
+	gralloc_drm_leak_fini(drm);
+	gralloc_drm_cache_fini(drm);
+	gralloc_drm_stall_fini(drm);
+	gralloc_drm_mutex_destroy(&drm->map_mutex);
+	gralloc_drm_mutex_destroy(&drm->import_mutex);
+	if (drm->heap)
+		drm->heap->destroy(drm->heap);
 	if (drm->drv)
 		drm->drv->destroy(drm->drv);
-	close(drm->fd);
+	if (drm->fd >= 0)
+		close(drm->fd);
 	free(drm);
 }
 
@@ -162,6 +920,38 @@ int gralloc_drm_get_fd(struct gralloc_drm_t *drm)
 	return drm->fd;
 }
 
+/*
+ * Return the bo this process has published in a handle, or NULL when the
+ * handle has not been imported yet.  It takes no lock: the bo is published
+ * before the owner pid, and both are read with acquire semantics.
+ */
+static struct gralloc_drm_bo_t *get_published_bo(
+		struct gralloc_drm_handle_t *handle)
+{
+	struct gralloc_drm_bo_t *bo;
+
+	if (__atomic_load_n(&handle->data_owner, __ATOMIC_ACQUIRE) !=
+			gralloc_drm_get_pid())
+		return NULL;
+
+	bo = __atomic_load_n(&handle->data, __ATOMIC_ACQUIRE);
+	if (bo && bo->handle != handle)
+		bo = NULL;
+
+	return bo;
+}
+
+/*
+ * Publish the bo of a handle for this process.
+ */
+static void publish_bo(struct gralloc_drm_handle_t *handle,
+		struct gralloc_drm_bo_t *bo)
+{
+	__atomic_store_n(&handle->data, bo, __ATOMIC_RELEASE);
+	__atomic_store_n(&handle->data_owner,
+			bo ? gralloc_drm_get_pid() : 0, __ATOMIC_RELEASE);
+}
+
 /*
  * Validate a buffer handle and return the associated bo.
  */
@@ -169,39 +959,70 @@ static struct gralloc_drm_bo_t *validate_handle(buffer_handle_t _handle,
 		struct gralloc_drm_t *drm)
 {
 	struct gralloc_drm_handle_t *handle = gralloc_drm_handle(_handle);
+	struct gralloc_drm_bo_t *bo;
 
 	if (!handle)
 		return NULL;
 
-	/* the buffer handle is passed to a new process */
-	ALOGV("data_owner=%d gralloc_pid=%d data=%p\n", handle->data_owner, gralloc_drm_get_pid(), handle->data);
-	if (unlikely((handle->data_owner != gralloc_drm_pid) ||
-	    ((handle->data != 0) && (handle != handle->data->handle)))) {
-		struct gralloc_drm_bo_t *bo;
+	bo = get_published_bo(handle);
+	if (likely(bo))
+		return bo;
 
-		/* check only */
-		if (!drm)
-			return NULL;
+	/* the buffer handle is passed to a new process; check only */
+	if (!drm)
+		return NULL;
+
+	/* imports are serialized, lookups are not */
+	gralloc_drm_mutex_lock(&drm->import_mutex);
+
+	bo = get_published_bo(handle);
+	if (!bo) {
+		/* the sender, which published the bo in its copy */
+		int sender = handle->data_owner;
 
 		ALOGV("handle: name=%d pfd=%d\n", handle->name,
 			handle->prime_fd);
+		struct gralloc_drm_drv_t *drv = gralloc_drm_get_drv(drm, handle);
+
 		/* create the struct gralloc_drm_bo_t locally */
-		if (handle->name || handle->prime_fd >= 0)
-			bo = drm->drv->alloc(drm->drv, handle);
-		else /* an invalid handle */
+		if (drv && (handle->name || handle->prime_fd >= 0)) {
+			gralloc_drm_timeline_begin("import");
+			bo = drv->alloc(drv, handle);
+			gralloc_drm_timeline_end("import");
+		}
+		else { /* an invalid handle */
 			bo = NULL;
+		}
 		if (bo) {
 			bo->drm = drm;
+			bo->drv = drv;
 			bo->imported = 1;
+			pthread_mutex_init(&bo->lock_mutex, NULL);
 			bo->handle = handle;
 			bo->refcount = 1;
+
+			publish_bo(handle, bo);
+			if (unlikely(drm->leaks))
+				gralloc_drm_leak_track(bo, sender);
 		}
 
-		handle->data_owner = gralloc_drm_get_pid();
-		handle->data = bo;
+		gralloc_drm_stats_import(drm, !bo);
 	}
 
-	return handle->data;
+	gralloc_drm_mutex_unlock(&drm->import_mutex);
+
+	return bo;
+}
+
+static void gralloc_drm_bo_destroy(struct gralloc_drm_bo_t *bo);
+
+/*
+ * Drop count references of a bo and destroy it when none is left.
+ */
+static void gralloc_drm_bo_put(struct gralloc_drm_bo_t *bo, int count)
+{
+	if (android_atomic_add(-count, &bo->refcount) == count)
+		gralloc_drm_bo_destroy(bo);
 }
 
 /*
@@ -215,13 +1036,14 @@ int gralloc_drm_handle_register(buffer_handle_t handle, struct gralloc_drm_t *dr
 	if (!bo)
 		return -EINVAL;
 
-	bo->refcount++;
+	android_atomic_inc(&bo->refcount);
 
 	return 0;
 }
 
 /*
  * Unregister a buffer handle.  It is no-op for handles created locally.
+ * The handle must not be registered again while this is in progress.
  */
 int gralloc_drm_handle_unregister(buffer_handle_t handle)
 {
@@ -231,9 +1053,8 @@ int gralloc_drm_handle_unregister(buffer_handle_t handle)
 	if (!bo)
 		return -EINVAL;
 
-	gralloc_drm_bo_decref(bo);
-	if (bo->imported)
-		gralloc_drm_bo_decref(bo);
+	/* drop the import reference as well */
+	gralloc_drm_bo_put(bo, (bo->imported) ? 2 : 1);
 
 	return 0;
 }
@@ -241,7 +1062,8 @@ int gralloc_drm_handle_unregister(buffer_handle_t handle)
 /*
  * Create a buffer handle.
  */
-static struct gralloc_drm_handle_t *create_bo_handle(int width,
+static struct gralloc_drm_handle_t *create_bo_handle(
+		struct gralloc_drm_t *drm, int width,
 		int height, int format, int usage)
 {
 	struct gralloc_drm_handle_t *handle;
@@ -259,6 +1081,9 @@ static struct gralloc_drm_handle_t *create_bo_handle(int width,
 	handle->height = height;
 	handle->format = format;
 	handle->usage = usage;
+	handle->heap = gralloc_drm_uses_heap(drm, usage);
+	/* set by the drivers that allocate explicit layouts */
+	handle->modifier = DRM_FORMAT_MOD_INVALID;
 	handle->prime_fd = -1;
 
 	return handle;
@@ -270,27 +1095,90 @@ static struct gralloc_drm_handle_t *create_bo_handle(int width,
 struct gralloc_drm_bo_t *gralloc_drm_bo_create(struct gralloc_drm_t *drm,
 		int width, int height, int format, int usage)
 {
+	int64_t start = gralloc_drm_get_time();
+	struct gralloc_drm_drv_t *drv;
 	struct gralloc_drm_bo_t *bo;
 	struct gralloc_drm_handle_t *handle;
 
-	handle = create_bo_handle(width, height, format, usage);
-	if (!handle)
+	/* the handle records the resolved format */
+	format = gralloc_drm_get_alloc_format(format, usage);
+
+	handle = create_bo_handle(drm, width, height, format, usage);
+	if (!handle) {
+		gralloc_drm_stats_alloc(drm, NULL, NULL, start, 0);
 		return NULL;
+	}
+
+	bo = gralloc_drm_cache_get(drm, handle);
+	if (bo) {
+		/* an exact match keeps its own handle */
+		if (bo->handle != handle)
+			free(handle);
+
+		if (!bo->needs_clear || !gralloc_drm_bo_clear(bo)) {
+			bo->exported = 0;
+			bo->fb_id = 0;
+			bo->lock_state = 0;
+			bo->refcount = 1;
+
+			publish_bo(bo->handle, bo);
+			gralloc_drm_stats_alloc(drm, bo->drv, bo, start, 1);
+			if (unlikely(drm->leaks))
+				gralloc_drm_leak_track(bo, gralloc_drm_get_pid());
+
+			return bo;
+		}
+
+		handle = bo->handle;
+		gralloc_drm_bo_free(bo);
+		free(handle);
+
+		handle = create_bo_handle(drm, width, height, format, usage);
+		if (!handle) {
+			gralloc_drm_stats_alloc(drm, NULL, NULL, start, 0);
+			return NULL;
+		}
+	}
 
-	bo = drm->drv->alloc(drm->drv, handle);
+	drv = gralloc_drm_get_drv(drm, handle);
+	gralloc_drm_timeline_begin("alloc");
+	bo = drv->alloc(drv, handle);
+	gralloc_drm_timeline_end("alloc");
 	if (!bo) {
 		free(handle);
+		gralloc_drm_stats_alloc(drm, drv, NULL, start, 0);
 		return NULL;
 	}
 
 	bo->drm = drm;
+	bo->drv = drv;
 	bo->imported = 0;
+	bo->exported = 0;
 	bo->handle = handle;
 	bo->fb_id = 0;
+
+	/*
+	 * the bo may be used by the GPU or another process before any lock.
+	 * Unlike a cached bo, a fresh one cannot be left to the clear worker:
+	 * it holds what another client left in VRAM until it is cleared, and
+	 * its handle is returned right away.  Once freed, it is cleared in
+	 * the cache, ahead of the next allocation of its size class.
+	 */
+	if (bo->needs_clear && gralloc_drm_bo_clear(bo)) {
+		ALOGE("failed to clear new bo");
+		drv->free(drv, bo);
+		free(handle);
+		gralloc_drm_stats_alloc(drm, drv, NULL, start, 0);
+		return NULL;
+	}
+
+	pthread_mutex_init(&bo->lock_mutex, NULL);
 	bo->refcount = 1;
 
-	handle->data_owner = gralloc_drm_get_pid();
-	handle->data = bo;
+	publish_bo(handle, bo);
+	gralloc_drm_stats_alloc(drm, drv, bo, start, 0);
+	if (unlikely(drm->leaks))
+		gralloc_drm_leak_track(bo, gralloc_drm_get_pid());
 
 	return bo;
 }
@@ -300,21 +1188,34 @@ struct gralloc_drm_bo_t *gralloc_drm_bo_create(struct gralloc_drm_t *drm,
  */
 static void gralloc_drm_bo_destroy(struct gralloc_drm_bo_t *bo)
 {
+	struct gralloc_drm_t *drm = bo->drm;
 	struct gralloc_drm_handle_t *handle = bo->handle;
 	int imported = bo->imported;
 
 	/* gralloc still has a reference */
-	if (bo->refcount)
+	if (android_atomic_acquire_load(&bo->refcount))
+		return;
+
+	gralloc_drm_leak_untrack(bo);
+
+	if (!imported)
+		gralloc_drm_stats_free(bo);
+
+	/* keep locally created bos around for gralloc_drm_bo_create */
+	if (!imported && !gralloc_drm_cache_put(bo))
 		return;
 
-	bo->drm->drv->free(bo->drm->drv, bo);
 	if (imported) {
-		handle->data_owner = 0;
-		handle->data = 0;
+		/* unpublish before the bo goes away */
+		gralloc_drm_mutex_lock(&drm->import_mutex);
+		if (handle->data == bo)
+			publish_bo(handle, NULL);
+		gralloc_drm_mutex_unlock(&drm->import_mutex);
 	}
-	else {
+
+	gralloc_drm_bo_free(bo);
+	if (!imported)
 		free(handle);
-	}
 }
 
 /*
@@ -322,8 +1223,7 @@ static void gralloc_drm_bo_destroy(struct gralloc_drm_bo_t *bo)
  */
 void gralloc_drm_bo_decref(struct gralloc_drm_bo_t *bo)
 {
-	if (!--bo->refcount)
-		gralloc_drm_bo_destroy(bo);
+	gralloc_drm_bo_put(bo, 1);
 }
 
 /*
@@ -350,6 +1250,47 @@ int gralloc_drm_get_gem_handle(buffer_handle_t _handle)
 	return (handle) ? handle->name : 0;
 }
 
+/*
+ * Return the size of the backing store of a bo, or of its pixels when the
+ * driver does not report it.
+ */
+int64_t gralloc_drm_bo_get_size(const struct gralloc_drm_bo_t *bo)
+{
+	if (bo->size)
+		return bo->size;
+
+	return (int64_t) bo->handle->stride * bo->handle->height;
+}
+
+/*
+ * Append text to a dump.  Text past the end of the buffer is dropped.
+ */
+void gralloc_drm_dump_printf(struct gralloc_drm_dump_buf *db,
+		const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (db->pos >= db->len)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(db->buf + db->pos, db->len - db->pos, fmt, ap);
+	va_end(ap);
+
+	if (n > 0)
+		db->pos += n;
+}
+
+/*
+ * Return the length of the text of a dump, which is truncated to len - 1
+ * bytes.
+ */
+int gralloc_drm_dump_length(const struct gralloc_drm_dump_buf *db)
+{
+	return (db->pos < db->len) ? db->pos : db->len - 1;
+}
+
 /*
  * Query YUV component offsets for a buffer handle
  */
@@ -358,21 +1299,207 @@ void gralloc_drm_resolve_format(buffer_handle_t _handle,
 {
 	struct gralloc_drm_handle_t *handle = gralloc_drm_handle(_handle);
 	struct gralloc_drm_bo_t *bo = handle->data;
-	struct gralloc_drm_t *drm = bo->drm;
+	struct gralloc_drm_drv_t *drv = bo->drv;
 
 	/* if handle exists and driver implements resolve_format */
-	if (handle && drm->drv->resolve_format)
-		drm->drv->resolve_format(drm->drv, bo,
+	if (handle && drv->resolve_format)
+		drv->resolve_format(drv, bo,
 			pitches, offsets, handles);
 }
 
 /*
- * Lock a bo.  XXX thread-safety?
+ * Return true if the mapping of a bo should be kept across locks.
+ */
+static int gralloc_drm_bo_keeps_map(struct gralloc_drm_bo_t *bo)
+{
+	int usage = bo->handle->usage;
+
+	if (!bo->drv->begin_cpu_access ||
+	    !bo->size || bo->size > bo->drm->map_max_bytes)
+		return 0;
+
+	return ((usage & GRALLOC_USAGE_SW_READ_MASK) ==
+			GRALLOC_USAGE_SW_READ_OFTEN ||
+		(usage & GRALLOC_USAGE_SW_WRITE_MASK) ==
+			GRALLOC_USAGE_SW_WRITE_OFTEN);
+}
+
+/*
+ * Return true if a bo should be mapped cached through its prime fd.  CPU
+ * reads of write-combined mappings are slow, so this is for bos that are
+ * read often.
+ */
+static int gralloc_drm_bo_uses_dmabuf(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_t *drm = bo->drm;
+
+	return (drm->dmabuf_map && bo->drv->prime_mappable &&
+		gralloc_drm_bo_is_linear(bo) &&
+		bo->handle->prime_fd >= 0 &&
+		bo->size && bo->size <= drm->map_max_bytes &&
+		(bo->handle->usage & GRALLOC_USAGE_SW_READ_MASK) ==
+			GRALLOC_USAGE_SW_READ_OFTEN);
+}
+
+/*
+ * Map a bo through its prime fd.  The mapping is always kept.
+ */
+static int gralloc_drm_bo_map_dmabuf(struct gralloc_drm_bo_t *bo)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			bo->handle->prime_fd, 0);
+	if (ptr == MAP_FAILED) {
+		ALOGE("failed to mmap dma-buf %d: %d",
+				bo->handle->prime_fd, -errno);
+		return -errno;
+	}
+
+	bo->map_addr = ptr;
+	bo->dmabuf_mapped = 1;
+	gralloc_drm_map_keep(bo);
+
+	return 0;
+}
+
+/*
+ * Compute the rectangle to map for a lock.  Only write locks, which are
+ * exclusive, map a part of a bo, so that readers can share one mapping.
+ * Planar formats are always mapped entirely as the chroma planes follow
+ * the luma plane.
+ */
+static void gralloc_drm_bo_get_map_rect(struct gralloc_drm_bo_t *bo,
+		int write, int *x, int *y, int *w, int *h)
+{
+	struct gralloc_drm_handle_t *handle = bo->handle;
+	struct gralloc_drm_layout layout;
+	int x1, y1, x2, y2;
+
+	if (gralloc_drm_get_layout(handle->format, handle->height,
+				handle->stride, &layout) > 1) {
+		*x = 0;
+		*y = 0;
+		*w = handle->width;
+		*h = layout.rows;
+		return;
+	}
+
+	x1 = (write && *x > 0) ? *x : 0;
+	y1 = (write && *y > 0) ? *y : 0;
+	x2 = (write && *w > 0) ? x1 + *w : handle->width;
+	y2 = (write && *h > 0) ? y1 + *h : handle->height;
+
+	if (x2 > handle->width)
+		x2 = handle->width;
+	if (y2 > handle->height)
+		y2 = handle->height;
+
+	/* an empty rectangle maps the whole bo */
+	if (x1 >= x2 || y1 >= y2) {
+		x1 = 0;
+		y1 = 0;
+		x2 = handle->width;
+		y2 = handle->height;
+	}
+
+	*x = x1;
+	*y = y1;
+	*w = x2 - x1;
+	*h = y2 - y1;
+}
+
+/*
+ * Map a bo for its first lock.  A kept mapping is only synchronized.  The
+ * lock mutex of the bo must be held.
+ */
+static int gralloc_drm_bo_map_locked(struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int write)
+{
+	struct gralloc_drm_drv_t *drv = bo->drv;
+	int err;
+
+	/* the driver maps the bo when its dma-buf cannot be */
+	if (!bo->map_kept && gralloc_drm_bo_uses_dmabuf(bo) &&
+	    gralloc_drm_bo_map_dmabuf(bo))
+		ALOGW("mapping bo %p through the driver instead", bo);
+
+	if (bo->dmabuf_mapped) {
+		/* the sync waits for the bo; the uAPI has no ranges */
+		bo->dmabuf_sync = (write) ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ;
+		return gralloc_drm_dmabuf_sync(bo->handle->prime_fd,
+				DMA_BUF_SYNC_START | bo->dmabuf_sync);
+	}
+
+	if (bo->map_kept)
+		return drv->begin_cpu_access(drv, bo, x, y, w, h, write);
+
+	/* the driver is supposed to wait for the bo */
+	err = drv->map(drv, bo, x, y, w, h, write, &bo->map_addr);
+	if (!err && gralloc_drm_bo_keeps_map(bo))
+		gralloc_drm_map_keep(bo);
+
+	return err;
+}
+
+/*
+ * Unmap a bo after its last unlock, or finish the CPU access of a kept
+ * mapping.  When fence_fd is not NULL, the driver may return a fence
+ * instead of flushing synchronously.  The lock mutex of the bo must be
+ * held.
+ */
+static void gralloc_drm_bo_unmap_locked(struct gralloc_drm_bo_t *bo,
+		int *fence_fd)
+{
+	struct gralloc_drm_drv_t *drv = bo->drv;
+
+	if (bo->dmabuf_mapped) {
+		gralloc_drm_dmabuf_sync(bo->handle->prime_fd, DMA_BUF_SYNC_END | bo->dmabuf_sync);
+	}
+	else if (bo->map_kept) {
+		if (drv->end_cpu_access)
+			drv->end_cpu_access(drv, bo);
+	}
+	else if (fence_fd && drv->unmap_async) {
+		drv->unmap_async(drv, bo, fence_fd);
+	}
+	else {
+		drv->unmap(drv, bo);
+	}
+}
+
+/*
+ * Return true if the mapping of a bo covers a rectangle.
+ */
+static int gralloc_drm_bo_map_covers(const struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h)
+{
+	return (x >= bo->map_x && y >= bo->map_y &&
+		x + w <= bo->map_x + bo->map_w &&
+		y + h <= bo->map_y + bo->map_h);
+}
+
+/*
+ * Lock a bo.
+ *
+ * Locks share the mapping of the bo, as a client may lock a bo again, or
+ * lock it for the CPU while it holds a lock for the GPU.  The first CPU
+ * lock maps the bo, writable for a write lock.  Only CPU locks conflict:
+ * a write lock fails with -EBUSY while CPU reads hold the mapping
+ * read-only, as does a lock whose rectangle the mapping does not cover.
+ * bo->lock_state holds the number of locks and whether the bo is mapped
+ * and mapped writable.  Adding a lock to a bo whose mapping suits or
+ * removing one that is not the last is a single compare-and-swap; only
+ * the first CPU lock and the last lock take the per-bo mutex to map and
+ * unmap the bo.
  */
 int gralloc_drm_bo_lock(struct gralloc_drm_bo_t *bo,
 		int usage, int x, int y, int w, int h,
 		void **addr)
 {
+	int sw, write, err = 0;
+	int32_t state, flags;
+
 	if ((bo->handle->usage & usage) != usage) {
 		/* make FB special for testing software renderer with */
 
@@ -380,94 +1507,261 @@ int gralloc_drm_bo_lock(struct gralloc_drm_bo_t *bo,
 		&&  !(bo->handle->usage & GRALLOC_USAGE_HW_TEXTURE)) {
 			ALOGE("bo.usage:x%X/usage:x%X is not GRALLOC_USAGE_HW_FB or GRALLOC_USAGE_HW_TEXTURE"
 				,bo->handle->usage,usage);
+			gralloc_drm_stats_lock(bo->drm, usage, -EINVAL);
 			return -EINVAL;
 		}
 	}
 
-	/* allow multiple locks with compatible usages */
-	if (bo->lock_count && (bo->locked_for & usage) != usage)
+	sw = !!(usage & (GRALLOC_USAGE_SW_WRITE_MASK |
+			 GRALLOC_USAGE_SW_READ_MASK));
+	write = !!(usage & GRALLOC_USAGE_SW_WRITE_MASK);
+
+	/* the CPU sees tiled bos at the stride of the handle only detiled */
+	if (sw && !gralloc_drm_bo_is_linear(bo) && !bo->drv->tiled_mappable) {
+		ALOGE("bo of modifier 0x%llx is not CPU accessible",
+				(unsigned long long) bo->handle->modifier);
+		gralloc_drm_stats_lock(bo->drm, usage, -EINVAL);
 		return -EINVAL;
+	}
 
-	usage |= bo->locked_for;
+	if (unlikely(bo->leak))
+		gralloc_drm_leak_lock(bo);
+
+	/* the mapping, if any, has to cover the rectangle */
+	if (sw)
+		gralloc_drm_bo_get_map_rect(bo, write, &x, &y, &w, &h);
+
+	/* join the other locks when their mapping suits */
+	state = android_atomic_acquire_load(&bo->lock_state);
+	while ((state & GRALLOC_DRM_LOCK_COUNT_MASK) &&
+	       (!sw || ((state & GRALLOC_DRM_LOCK_MAPPED) &&
+			(!write || (state & GRALLOC_DRM_LOCK_WRITABLE))))) {
+		if (!android_atomic_acquire_cas(state, state + 1,
+					&bo->lock_state)) {
+			/* the mapping cannot change while the bo is locked */
+			if (sw && !gralloc_drm_bo_map_covers(bo, x, y, w, h)) {
+				gralloc_drm_bo_unlock(bo);
+				break;
+			}
+
+			if (sw)
+				*addr = bo->map_addr;
+			gralloc_drm_stats_lock(bo->drm, usage, 0);
+			return 0;
+		}
+		state = android_atomic_acquire_load(&bo->lock_state);
+	}
 
-	if (usage & (GRALLOC_USAGE_SW_WRITE_MASK |
-		     GRALLOC_USAGE_SW_READ_MASK)) {
-		/* the driver is supposed to wait for the bo */
-		int write = !!(usage & GRALLOC_USAGE_SW_WRITE_MASK);
-		int err = bo->drm->drv->map(bo->drm->drv, bo,
-				x, y, w, h, write, addr);
+	pthread_mutex_lock(&bo->lock_mutex);
+
+	state = android_atomic_acquire_load(&bo->lock_state);
+	flags = 0;
+	if (sw && (state & GRALLOC_DRM_LOCK_MAPPED)) {
+		/* CPU reads hold the mapping read-only */
+		if ((write && !(state & GRALLOC_DRM_LOCK_WRITABLE)) ||
+		    !gralloc_drm_bo_map_covers(bo, x, y, w, h)) {
+			err = -EBUSY;
+			goto out;
+		}
+	}
+	else if (sw) {
+		int64_t start, wait = 0;
+
+		/* time the wait for the GPU apart from the map */
+		if (unlikely(bo->drm->stalls))
+			wait = gralloc_drm_stall_wait(bo, write);
+
+		start = gralloc_drm_get_time();
+		gralloc_drm_timeline_begin("map");
+		err = gralloc_drm_bo_map_locked(bo, x, y, w, h, write);
+		gralloc_drm_timeline_end("map");
+		gralloc_drm_stats_map(bo->drm, start);
+		if (unlikely(bo->drm->stalls) && !err)
+			gralloc_drm_stall_record(bo, usage, wait, start);
 		if (err)
-			return err;
+			goto out;
+
+		bo->map_x = x;
+		bo->map_y = y;
+		bo->map_w = w;
+		bo->map_h = h;
+		flags = GRALLOC_DRM_LOCK_MAPPED;
+		if (write)
+			flags |= GRALLOC_DRM_LOCK_WRITABLE;
 	}
 	else {
 		/* kernel handles the synchronization here */
 	}
 
-	bo->lock_count++;
-	bo->locked_for |= usage;
+	/* other locks may come and go meanwhile, but never the last one */
+	while (android_atomic_release_cas(state, (state | flags) + 1,
+				&bo->lock_state))
+		state = android_atomic_acquire_load(&bo->lock_state);
 
-	return 0;
+	if (sw)
+		*addr = bo->map_addr;
+
+out:
+	pthread_mutex_unlock(&bo->lock_mutex);
+
+	gralloc_drm_stats_lock(bo->drm, usage, err);
+
+	return err;
 }
 
 int gralloc_drm_bo_lock_ycbcr(struct gralloc_drm_bo_t *bo,
 		int usage, int x, int y, int w, int h,
 		struct android_ycbcr *ycbcr)
 {
-	int ystride, cstride;
-	void *ptr = 0;
+	struct gralloc_drm_handle_t *handle = bo->handle;
+	struct gralloc_drm_layout layout;
+	uint8_t *ptr;
+	void *addr = 0;
 	int err;
-	struct gralloc_drm_handle_t *handle;
 
-	handle = bo->handle;
+	if (gralloc_drm_get_layout(handle->format, handle->height,
+				handle->stride, &layout) < 2)
+		return -EINVAL;
 
-	err = gralloc_drm_bo_lock(bo, usage, x, y, w, h, &ptr);
+	err = gralloc_drm_bo_lock(bo, usage, x, y, w, h, &addr);
 	if (err)
 		return err;
 
+	ptr = (uint8_t *) addr;
+
 	memset(ycbcr->reserved, 0, sizeof(ycbcr->reserved));
+	ycbcr->y = ptr;
+	ycbcr->ystride = layout.strides[0];
+	ycbcr->cstride = layout.strides[1];
+	ycbcr->chroma_step = layout.chroma_step;
 
-	switch(handle->format) {
-	case HAL_PIXEL_FORMAT_YV12:
-		ystride = handle->stride / 2;
-		cstride = ALIGN(ystride / 2, 16);
-		ycbcr->y = ptr;
-		ycbcr->cr = (uint8_t *)ptr + ystride * handle->height;
-		ycbcr->cb = (uint8_t *)ptr + ystride * handle->height + cstride *  handle->height / 2;
-		ycbcr->ystride = ystride;
-		ycbcr->cstride = cstride;
-		ycbcr->chroma_step = 1;
-		break;
-	case HAL_PIXEL_FORMAT_YCBCR_420_888:
-		ystride = cstride = ALIGN(handle->stride / 2, 16);
-		ycbcr->y = ptr;
-		ycbcr->cb = (uint8_t *)ptr + ystride * handle->height;
-		ycbcr->cr = (uint8_t *)ycbcr->cb + 1;
-		ycbcr->ystride = ystride;
-		ycbcr->cstride = cstride;
-		ycbcr->chroma_step = 2;
-		break;
-	default:
+	ycbcr->cb = ptr + layout.cb_offset;
+	ycbcr->cr = ptr + layout.cr_offset;
+
+	return 0;
+}
+
+/*
+ * Write back (flush) or drop (invalidate) the CPU caches of a bo that is
+ * locked for CPU access.  Only cached mappings need it; others are
+ * coherent with the device.
+ */
+int gralloc_drm_bo_sync_cpu(struct gralloc_drm_bo_t *bo, int flush)
+{
+	uint64_t flags;
+	int err;
+
+	if (!(android_atomic_acquire_load(&bo->lock_state) &
+	      GRALLOC_DRM_LOCK_MAPPED))
 		return -EINVAL;
+
+	if (!bo->dmabuf_mapped)
+		return 0;
+
+	/* ending the access writes back, starting it again invalidates */
+	flags = bo->dmabuf_sync;
+	if (flush && !(flags & DMA_BUF_SYNC_WRITE))
+		return 0;
+
+	err = gralloc_drm_dmabuf_sync(bo->handle->prime_fd, DMA_BUF_SYNC_END | flags);
+	if (!err)
+		err = gralloc_drm_dmabuf_sync(bo->handle->prime_fd, DMA_BUF_SYNC_START | flags);
+
+	return err;
+}
+
+/*
+ * Wait for the acquire fence of a lock and close it.  Locks without CPU
+ * access leave the synchronization to the kernel and do not wait.
+ */
+int gralloc_drm_bo_wait_fence(struct gralloc_drm_bo_t *bo, int usage,
+		int fence_fd)
+{
+	int err = 0;
+
+	if (fence_fd < 0)
+		return 0;
+
+	if (usage & (GRALLOC_USAGE_SW_WRITE_MASK |
+		     GRALLOC_USAGE_SW_READ_MASK)) {
+		if (sync_wait(fence_fd, -1)) {
+			err = -errno;
+			ALOGE("failed to wait for fence %d: %d", fence_fd, err);
+		}
 	}
 
-	return 0;
+	close(fence_fd);
+
+	return err;
 }
 
 /*
- * Unlock a bo.
+ * Unlock a bo.  When fence_fd is not NULL, it is set to a release fence
+ * or to -1 if the unlock completed synchronously.
  */
-void gralloc_drm_bo_unlock(struct gralloc_drm_bo_t *bo)
+static void gralloc_drm_bo_unlock_fence(struct gralloc_drm_bo_t *bo,
+		int *fence_fd)
 {
-	int mapped = bo->locked_for &
-		(GRALLOC_USAGE_SW_WRITE_MASK | GRALLOC_USAGE_SW_READ_MASK);
+	int32_t state;
+
+	if (fence_fd)
+		*fence_fd = -1;
+
+	/* leave when there are other locks */
+	state = android_atomic_acquire_load(&bo->lock_state);
+	while ((state & GRALLOC_DRM_LOCK_COUNT_MASK) > 1) {
+		if (!android_atomic_release_cas(state, state - 1,
+					&bo->lock_state))
+			return;
+		state = android_atomic_acquire_load(&bo->lock_state);
+	}
 
-	if (!bo->lock_count)
+	if (!(state & GRALLOC_DRM_LOCK_COUNT_MASK))
 		return;
 
-	if (mapped)
-		bo->drm->drv->unmap(bo->drm->drv, bo);
+	pthread_mutex_lock(&bo->lock_mutex);
 
-	bo->lock_count--;
-	if (!bo->lock_count)
-		bo->locked_for = 0;
+	while (1) {
+		int32_t count = state & GRALLOC_DRM_LOCK_COUNT_MASK;
+
+		if (!count)
+			break;
+
+		if (count > 1) {
+			if (!android_atomic_release_cas(state, state - 1,
+						&bo->lock_state))
+				break;
+		}
+		else if (!android_atomic_release_cas(state, 0,
+					&bo->lock_state)) {
+			/* no lock can join anymore */
+			if (state & GRALLOC_DRM_LOCK_MAPPED) {
+				gralloc_drm_timeline_begin("unmap");
+				gralloc_drm_bo_unmap_locked(bo, fence_fd);
+				gralloc_drm_timeline_end("unmap");
+			}
+			break;
+		}
+
+		state = android_atomic_acquire_load(&bo->lock_state);
+	}
+
+	pthread_mutex_unlock(&bo->lock_mutex);
+}
+
+/*
+ * Unlock a bo.
+ */
+void gralloc_drm_bo_unlock(struct gralloc_drm_bo_t *bo)
+{
+	gralloc_drm_bo_unlock_fence(bo, NULL);
+}
+
+/*
+ * Unlock a bo and return a release fence instead of waiting for the flush
+ * of CPU writes.
+ */
+void gralloc_drm_bo_unlock_async(struct gralloc_drm_bo_t *bo, int *fence_fd)
+{
+	gralloc_drm_bo_unlock_fence(bo, fence_fd);
 }
@@ -26,6 +26,9 @@
 
 #include <hardware/gralloc.h>
 #include <system/graphics.h>
+#include <stdint.h>
+
+#include "gralloc_drm_formats.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,77 +41,215 @@ struct gralloc_drm_bo_t;
 
 enum {
 	GRALLOC_MODULE_PERFORM_GET_DRM_FD                = 0x80000002,
+	/* (buffer_handle_t), write back CPU caches of a locked buffer */
+	GRALLOC_MODULE_PERFORM_FLUSH                     = 0x80000003,
+	/* (buffer_handle_t), drop stale CPU caches of a locked buffer */
+	GRALLOC_MODULE_PERFORM_INVALIDATE                = 0x80000004,
+	/* (struct gralloc_drm_stats *), snapshot the counters */
+	GRALLOC_MODULE_PERFORM_GET_STATS                 = 0x80000005,
+	/* (char *buf, int len), describe the counters as text */
+	GRALLOC_MODULE_PERFORM_DUMP                      = 0x80000006,
+	/* (const char *path), write the timeline, to the default path if NULL */
+	GRALLOC_MODULE_PERFORM_FLUSH_TIMELINE            = 0x80000007,
+	/*
+	 * (struct gralloc_drm_stall *stalls, int *count), the buffers whose
+	 * locks waited the longest for the GPU, longest first; count is the
+	 * size of the array on entry and the number of entries on return
+	 */
+	GRALLOC_MODULE_PERFORM_GET_STALLS                = 0x80000008,
+	/*
+	 * (struct gralloc_drm_lock_stats *stats, int *count), the contention
+	 * of the internal mutexes; count is the size of the array on entry
+	 * and the number of entries on return
+	 */
+	GRALLOC_MODULE_PERFORM_GET_LOCK_STATS            = 0x80000009,
+	/*
+	 * (char *buf, int len), describe the live buffers with where they
+	 * come from, when gralloc.drm.leak_track is set
+	 */
+	GRALLOC_MODULE_PERFORM_DUMP_BUFFERS              = 0x8000000a,
+};
+
+#define GRALLOC_DRM_STATS_VERSION 1
+
+/*
+ * Latency histograms: bucket 0 counts calls under 1 us, bucket n those
+ * under 2^n us, and the last bucket everything slower.
+ */
+#define GRALLOC_DRM_STATS_BUCKETS 20
+
+/* the bytes of the first formats allocated are counted per format */
+#define GRALLOC_DRM_STATS_FORMATS 16
+
+/* a bo is in the first class its usage matches */
+enum {
+	GRALLOC_DRM_STATS_USAGE_CAMERA,
+	GRALLOC_DRM_STATS_USAGE_VIDEO,
+	GRALLOC_DRM_STATS_USAGE_FB,
+	GRALLOC_DRM_STATS_USAGE_COMPOSER,
+	GRALLOC_DRM_STATS_USAGE_RENDER,
+	GRALLOC_DRM_STATS_USAGE_TEXTURE,
+	GRALLOC_DRM_STATS_USAGE_SW,
+	GRALLOC_DRM_STATS_USAGE_COUNT
+};
+
+enum {
+	GRALLOC_DRM_STATS_DRV_GPU,
+	GRALLOC_DRM_STATS_DRV_HEAP, /* bos the GPU does not use */
+	GRALLOC_DRM_STATS_DRV_COUNT
+};
+
+/*
+ * Counters of the core since it was created, per process.  Byte counts
+ * are those of the bos created by the process and not yet freed.
+ */
+struct gralloc_drm_stats {
+	uint32_t version;
+	uint32_t size;
+
+	int64_t allocs;
+	int64_t alloc_failures;
+	int64_t cache_hits;
+	int64_t frees;
+	int64_t imports;
+	int64_t import_failures;
+
+	int64_t locks_read;  /* for CPU reads only */
+	int64_t locks_write; /* for CPU writes */
+	int64_t locks_hw;    /* without CPU access */
+	int64_t lock_failures;
+
+	int64_t bytes;
+	int64_t bytes_by_usage[GRALLOC_DRM_STATS_USAGE_COUNT];
+	struct {
+		int64_t format; /* 0 for an unused slot */
+		int64_t bytes;
+	} bytes_by_format[GRALLOC_DRM_STATS_FORMATS];
+	int64_t bytes_other_formats;
+
+	int64_t alloc_latency[GRALLOC_DRM_STATS_BUCKETS];
+	int64_t map_latency[GRALLOC_DRM_STATS_BUCKETS];
+
+	struct {
+		int64_t allocs;
+		int64_t failures;
+	} drivers[GRALLOC_DRM_STATS_DRV_COUNT];
+
+	/* not counters, sampled by the snapshot */
+	int64_t cached_bytes;
+	int64_t mapped_bytes;
+};
+
+/*
+ * The locks of a buffer with a usage by a thread that mapped it, when
+ * gralloc.drm.stall_profile is set.
+ */
+struct gralloc_drm_stall {
+	uint64_t buffer; /* identifies the buffer while it is alive */
+	int32_t width;
+	int32_t height;
+	int32_t format;
+	int32_t usage;   /* of the locks */
+	int32_t tid;
+
+	int32_t maps;
+	int32_t stalls;  /* maps that found the buffer busy */
+	int64_t wait_ns; /* for the GPU, in total */
+	int64_t max_wait_ns;
+	int64_t map_ns;  /* in total, without the waits */
+};
+
+/* the call sites of a mutex are counted apart for the first ones seen */
+#define GRALLOC_DRM_LOCK_SITES 8
+
+struct gralloc_drm_lock_site {
+	char name[32];
+	int64_t locks;
+	int64_t contentions;
+	int64_t wait_ns;
+	int64_t hold_ns;
+};
+
+/*
+ * The contention of an internal mutex of gralloc since
+ * gralloc.drm.lock_profile was set.  A call site is the function that
+ * locked the mutex.
+ */
+struct gralloc_drm_lock_stats {
+	char name[16];
+
+	int64_t locks;
+	int64_t contentions; /* locks that found the mutex held */
+	int64_t wait_ns;     /* for the mutex, in total */
+	int64_t max_wait_ns;
+	int64_t hold_ns;     /* in total */
+	int64_t max_hold_ns;
+
+	/* the longest wait, by whom and for whom */
+	int32_t max_wait_tid;
+	int32_t max_wait_owner_tid;
+	char max_wait_site[32];
+	char max_wait_owner_site[32];
+	char max_hold_site[32];
+
+	int32_t site_count;
+	struct gralloc_drm_lock_site sites[GRALLOC_DRM_LOCK_SITES];
 };
 
 struct gralloc_drm_t *gralloc_drm_create(void);
 void gralloc_drm_destroy(struct gralloc_drm_t *drm);
 
 int gralloc_drm_get_fd(struct gralloc_drm_t *drm);
+void gralloc_drm_get_stats(struct gralloc_drm_t *drm, struct gralloc_drm_stats *stats);
+int gralloc_drm_dump_stats(struct gralloc_drm_t *drm, char *buf, int len);
+int gralloc_drm_get_stalls(struct gralloc_drm_t *drm, struct gralloc_drm_stall *stalls, int *count);
+int gralloc_drm_dump_stalls(struct gralloc_drm_t *drm, char *buf, int len);
+int gralloc_drm_get_lock_stats(struct gralloc_drm_lock_stats *stats, int *count);
+int gralloc_drm_dump_lock_stats(char *buf, int len);
+int gralloc_drm_dump_buffers(struct gralloc_drm_t *drm, char *buf, int len);
 
-static inline int gralloc_drm_get_bpp(int format)
-{
-	int bpp;
-
-	switch (format) {
-	case HAL_PIXEL_FORMAT_RGBA_8888:
-	case HAL_PIXEL_FORMAT_RGBX_8888:
-	case HAL_PIXEL_FORMAT_BGRA_8888:
-		bpp = 4;
-		break;
-	case HAL_PIXEL_FORMAT_RGB_888:
-		bpp = 3;
-		break;
-	case HAL_PIXEL_FORMAT_RGB_565:
-	case HAL_PIXEL_FORMAT_YCbCr_422_I:
-	case HAL_PIXEL_FORMAT_YV12:
-	case HAL_PIXEL_FORMAT_YCBCR_420_888:
-		bpp = 2;
-		break;
-	case HAL_PIXEL_FORMAT_BLOB:
-	/* planar; only Y is considered */
-	case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-	case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-		bpp = 1;
-		break;
-	default:
-		bpp = 0;
-		break;
-	}
-
-	return bpp;
-}
+#define GRALLOC_DRM_MAX_PLANES 3
 
-static inline void gralloc_drm_align_geometry(int format, int *width, int *height)
-{
-	int align_w = 1, align_h = 1, extra_height_div = 0;
-
-	switch (format) {
-	case HAL_PIXEL_FORMAT_YV12:
-		align_w = 32;
-		align_h = 2;
-		extra_height_div = 2;
-		break;
-	case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-		align_w = 2;
-		extra_height_div = 1;
-		break;
-	case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-	case HAL_PIXEL_FORMAT_YCbCr_420_888:
-		align_w = 2;
-		align_h = 2;
-		extra_height_div = 2;
-		break;
-	case HAL_PIXEL_FORMAT_YCbCr_422_I:
-		align_w = 2;
-		break;
-	}
-
-	*width = ALIGN(*width, align_w);
-	*height = ALIGN(*height, align_h);
-
-	if (extra_height_div)
-		*height += *height / extra_height_div;
-}
+/*
+ * A format, see gralloc_drm_formats.c.  Planes after the first are chroma
+ * planes subsampled by hsub and vsub, which follow the first plane in the
+ * same bo.  A sample of a plane is a pixel or, for interleaved chroma, a
+ * Cb and Cr pair.
+ */
+struct gralloc_drm_format {
+	int format;       /* HAL_PIXEL_FORMAT_* */
+	const char *name;
+	uint32_t fourcc;  /* DRM_FORMAT_*, whose planes are in the same order */
+	int num_planes;
+	int bpp[GRALLOC_DRM_MAX_PLANES]; /* bytes per sample */
+	int hsub, vsub;
+	int align_w, align_h;  /* of the geometry, in pixels; 0 for none */
+	int chroma_align;      /* of the chroma strides, in bytes */
+
+	/* the first Cb and Cr samples, as a plane and a byte offset */
+	int cb_plane, cb_offset;
+	int cr_plane, cr_offset;
+};
+
+/* the planes of a bo, see gralloc_drm_get_layout */
+struct gralloc_drm_layout {
+	int num_planes;
+	uint32_t offsets[GRALLOC_DRM_MAX_PLANES];
+	uint32_t strides[GRALLOC_DRM_MAX_PLANES];
+	uint32_t cb_offset, cr_offset; /* of the first chroma samples */
+	int chroma_step;  /* bytes between chroma samples */
+	int rows;         /* rows of the first stride that hold all planes */
+	size_t size;
+};
+
+const struct gralloc_drm_format *gralloc_drm_get_format(int format);
+int gralloc_drm_get_formats(const struct gralloc_drm_format **formats);
+int gralloc_drm_get_alloc_format(int format, int usage);
+int gralloc_drm_get_bpp(int format);
+uint32_t gralloc_drm_get_fourcc(int format);
+void gralloc_drm_align_geometry(int format, int *width, int *height);
+int gralloc_drm_get_layout(int format, int height, int stride,
+		struct gralloc_drm_layout *layout);
 
 int gralloc_drm_handle_register(buffer_handle_t handle, struct gralloc_drm_t *drm);
 int gralloc_drm_handle_unregister(buffer_handle_t handle);
@@ -125,6 +266,9 @@ unsigned int planes_for_format(struct gralloc_drm_t *drm, int hal_format);
 int gralloc_drm_bo_lock(struct gralloc_drm_bo_t *bo, int usage, int x, int y, int w, int h, void **addr);
 int gralloc_drm_bo_lock_ycbcr(struct gralloc_drm_bo_t *bo, int usage, int x, int y, int w, int h, struct android_ycbcr *ycbcr);
 void gralloc_drm_bo_unlock(struct gralloc_drm_bo_t *bo);
+int gralloc_drm_bo_wait_fence(struct gralloc_drm_bo_t *bo, int usage, int fence_fd);
+void gralloc_drm_bo_unlock_async(struct gralloc_drm_bo_t *bo, int *fence_fd);
+int gralloc_drm_bo_sync_cpu(struct gralloc_drm_bo_t *bo, int flush);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A driver for any KMS device.  Bos are dumb buffers, which are linear and
+ * CPU-mappable, shared through prime fds.
+ */
+
+#define LOG_TAG "GRALLOC-DUMB"
+
+#include <log/log.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+struct dumb_info {
+	struct gralloc_drm_drv_t base;
+
+	/* dumb buffers can only be created on primary nodes */
+	int fd;
+};
+
+struct dumb_buffer {
+	struct gralloc_drm_bo_t base;
+
+	uint32_t gem_handle;
+	void *ptr;
+	uint64_t sync; /* DMA_BUF_SYNC_* of the CPU access */
+};
+
+static void dumb_destroy(struct gralloc_drm_drv_t *drv)
+{
+	struct dumb_info *info = (struct dumb_info *) drv;
+
+	close(info->fd);
+	free(info);
+}
+
+/* return the pitch alignment for the usage of a bo */
+static int dumb_get_pitch_align(int usage)
+{
+	/* display engines and samplers want more than a cache line */
+	if (usage & (GRALLOC_USAGE_HW_FB |
+		     GRALLOC_USAGE_HW_COMPOSER |
+		     GRALLOC_USAGE_HW_TEXTURE |
+		     GRALLOC_USAGE_HW_RENDER))
+		return 256;
+
+	return 64;
+}
+
+/* compute the pitch and the size of a handle */
+static int dumb_get_layout(const struct gralloc_drm_handle_t *handle,
+		int *pitch, size_t *size)
+{
+	int cpp, aligned_width, aligned_height;
+
+	cpp = gralloc_drm_get_bpp(handle->format);
+	if (!cpp) {
+		ALOGE("unrecognized format 0x%x", handle->format);
+		return -EINVAL;
+	}
+
+	aligned_width = handle->width;
+	aligned_height = handle->height;
+	gralloc_drm_align_geometry(handle->format,
+			&aligned_width, &aligned_height);
+
+	*pitch = ALIGN(aligned_width * cpp, dumb_get_pitch_align(handle->usage));
+	*size = (size_t) *pitch * aligned_height;
+
+	return 0;
+}
+
+/* create a dumb buffer of at least size bytes */
+static int dumb_create(struct dumb_info *info, int pitch, size_t size,
+		uint32_t *gem_handle, size_t *bo_size)
+{
+	struct drm_mode_create_dumb create;
+	int ret;
+
+	/*
+	 * Describe the buffer as pitch-wide rows of bytes so that the
+	 * kernel does not impose its own pitch.  The layout is ours.
+	 */
+	memset(&create, 0, sizeof(create));
+	create.width = pitch;
+	create.height = (size + pitch - 1) / pitch;
+	create.bpp = 8;
+
+	ret = drmIoctl(info->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create);
+	if (ret) {
+		ALOGE("failed to create dumb buffer %ux%u: %d",
+				create.width, create.height, -errno);
+		return -errno;
+	}
+
+	*gem_handle = create.handle;
+	*bo_size = create.size;
+
+	return 0;
+}
+
+static void dumb_close(struct dumb_info *info, uint32_t gem_handle)
+{
+	struct drm_mode_destroy_dumb destroy;
+
+	memset(&destroy, 0, sizeof(destroy));
+	destroy.handle = gem_handle;
+	drmIoctl(info->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+}
+
+static struct gralloc_drm_bo_t *dumb_alloc(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct dumb_info *info = (struct dumb_info *) drv;
+	struct dumb_buffer *buf;
+	size_t size;
+	int pitch;
+
+	if (dumb_get_layout(handle, &pitch, &size))
+		return NULL;
+
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	if (handle->prime_fd >= 0) {
+		off_t end;
+
+		if (drmPrimeFDToHandle(info->fd, handle->prime_fd,
+					&buf->gem_handle)) {
+			ALOGE("failed to import prime fd %d", handle->prime_fd);
+			free(buf);
+			return NULL;
+		}
+
+		end = lseek(handle->prime_fd, 0, SEEK_END);
+		if (end > 0)
+			size = (size_t) end;
+	}
+	else {
+		/* round up so that the bo can be re-described */
+		if (dumb_create(info, pitch, gralloc_drm_size_class(size),
+					&buf->gem_handle, &size)) {
+			free(buf);
+			return NULL;
+		}
+
+		if (drmPrimeHandleToFD(info->fd, buf->gem_handle,
+					DRM_CLOEXEC | DRM_RDWR,
+					&handle->prime_fd)) {
+			ALOGE("failed to export dumb buffer");
+			dumb_close(info, buf->gem_handle);
+			free(buf);
+			return NULL;
+		}
+
+		handle->stride = pitch;
+	}
+
+	handle->name = 0;
+
+	buf->base.fb_handle = buf->gem_handle;
+	buf->base.size = size;
+	buf->base.handle = handle;
+
+	return &buf->base;
+}
+
+static void dumb_free(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct dumb_info *info = (struct dumb_info *) drv;
+	struct dumb_buffer *buf = (struct dumb_buffer *) bo;
+
+	/* the prime fd of an imported handle belongs to its owner */
+	if (!bo->imported && bo->handle->prime_fd >= 0) {
+		close(bo->handle->prime_fd);
+		bo->handle->prime_fd = -1;
+	}
+
+	dumb_close(info, buf->gem_handle);
+	free(buf);
+}
+
+static int dumb_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write)
+{
+	struct dumb_buffer *buf = (struct dumb_buffer *) bo;
+
+	/*
+	 * dumb buffers are not rendered to, but mappings of the prime fd
+	 * may be cached and the CPU caches need maintenance
+	 */
+	if (bo->handle->prime_fd < 0)
+		return 0;
+
+	/* the uAPI has no ranges */
+	buf->sync = (enable_write) ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ;
+
+	return gralloc_drm_dmabuf_sync(bo->handle->prime_fd,
+			DMA_BUF_SYNC_START | buf->sync);
+}
+
+static void dumb_end_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct dumb_buffer *buf = (struct dumb_buffer *) bo;
+
+	/* kept mappings are unmapped outside of CPU access too */
+	if (!buf->sync)
+		return;
+
+	gralloc_drm_dmabuf_sync(bo->handle->prime_fd,
+			DMA_BUF_SYNC_END | buf->sync);
+	buf->sync = 0;
+}
+
+static int dumb_map(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write, void **addr)
+{
+	struct dumb_info *info = (struct dumb_info *) drv;
+	struct dumb_buffer *buf = (struct dumb_buffer *) bo;
+	struct drm_mode_map_dumb map;
+	void *ptr;
+	int err;
+
+	/* mappings of dma-bufs are cached where the exporter allows it */
+	ptr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			bo->handle->prime_fd, 0);
+	if (ptr == MAP_FAILED) {
+		memset(&map, 0, sizeof(map));
+		map.handle = buf->gem_handle;
+		if (drmIoctl(info->fd, DRM_IOCTL_MODE_MAP_DUMB, &map)) {
+			ALOGE("failed to get dumb buffer offset: %d", -errno);
+			return -errno;
+		}
+
+		ptr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				info->fd, map.offset);
+		if (ptr == MAP_FAILED) {
+			ALOGE("failed to map dumb buffer: %d", -errno);
+			return -errno;
+		}
+	}
+
+	err = dumb_begin_cpu_access(drv, bo, x, y, w, h, enable_write);
+	if (err) {
+		munmap(ptr, bo->size);
+		return err;
+	}
+
+	buf->ptr = ptr;
+	*addr = ptr;
+
+	return 0;
+}
+
+static void dumb_unmap(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct dumb_buffer *buf = (struct dumb_buffer *) bo;
+
+	dumb_end_cpu_access(drv, bo);
+	munmap(buf->ptr, bo->size);
+	buf->ptr = NULL;
+}
+
+static int dumb_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	size_t size;
+	int pitch;
+
+	if (dumb_get_layout(handle, &pitch, &size) ||
+	    !gralloc_drm_size_class_match(size, bo->size))
+		return -EINVAL;
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
+}
+
+/*
+ * Open the primary node of the device of a DRM fd.
+ */
+static int dumb_open_primary(int fd)
+{
+	char *name;
+	int primary;
+
+	if (drmGetNodeTypeFromFd(fd) == DRM_NODE_PRIMARY)
+		return dup(fd);
+
+	name = drmGetPrimaryDeviceNameFromFd(fd);
+	if (!name) {
+		ALOGE("failed to find the primary node");
+		return -1;
+	}
+
+	primary = open(name, O_RDWR | O_CLOEXEC);
+	if (primary < 0)
+		ALOGE("failed to open %s", name);
+	free(name);
+
+	return primary;
+}
+
+struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_dumb(int fd)
+{
+	struct dumb_info *info;
+	uint64_t cap = 0;
+
+	info = calloc(1, sizeof(*info));
+	if (!info)
+		return NULL;
+
+	info->fd = dumb_open_primary(fd);
+	if (info->fd < 0) {
+		free(info);
+		return NULL;
+	}
+
+	if (drmGetCap(info->fd, DRM_CAP_DUMB_BUFFER, &cap) || !cap) {
+		ALOGE("dumb buffers are not supported");
+		close(info->fd);
+		free(info);
+		return NULL;
+	}
+
+	info->base.destroy = dumb_destroy;
+	info->base.alloc = dumb_alloc;
+	info->base.free = dumb_free;
+	info->base.map = dumb_map;
+	info->base.unmap = dumb_unmap;
+	info->base.begin_cpu_access = dumb_begin_cpu_access;
+	info->base.end_cpu_access = dumb_end_cpu_access;
+	info->base.redescribe = dumb_redescribe;
+	info->base.prime_mappable = 1;
+
+	return &info->base;
+}
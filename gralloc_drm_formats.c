@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The formats gralloc allocates.  A format is described once, in
+ * gralloc_drm_formats, and its bpp, geometry, plane layout and DRM fourcc
+ * are derived from the descriptor.
+ */
+
+#define LOG_TAG "GRALLOC-FORMATS"
+
+#include <log/log.h>
+#include <string.h>
+#include <pthread.h>
+#include <drm_fourcc.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_formats.h"
+
+static const struct gralloc_drm_format gralloc_drm_formats[] = {
+	{
+		.format = HAL_PIXEL_FORMAT_RGBA_8888,
+		.name = "RGBA_8888",
+		.fourcc = DRM_FORMAT_ABGR8888,
+		.num_planes = 1,
+		.bpp = { 4 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_RGBX_8888,
+		.name = "RGBX_8888",
+		.fourcc = DRM_FORMAT_XBGR8888,
+		.num_planes = 1,
+		.bpp = { 4 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_BGRA_8888,
+		.name = "BGRA_8888",
+		.fourcc = DRM_FORMAT_ARGB8888,
+		.num_planes = 1,
+		.bpp = { 4 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_RGBA_FP16,
+		.name = "RGBA_FP16",
+		.fourcc = DRM_FORMAT_ABGR16161616F,
+		.num_planes = 1,
+		.bpp = { 8 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_RGBA_1010102,
+		.name = "RGBA_1010102",
+		.fourcc = DRM_FORMAT_ABGR2101010,
+		.num_planes = 1,
+		.bpp = { 4 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_RGB_888,
+		.name = "RGB_888",
+		.fourcc = DRM_FORMAT_BGR888,
+		.num_planes = 1,
+		.bpp = { 3 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_RGB_565,
+		.name = "RGB_565",
+		.fourcc = DRM_FORMAT_RGB565,
+		.num_planes = 1,
+		.bpp = { 2 },
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_YCbCr_422_I,
+		.name = "YCbCr_422_I",
+		.fourcc = DRM_FORMAT_YUYV,
+		.num_planes = 1,
+		.bpp = { 2 },
+		.align_w = 2,
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_BLOB,
+		.name = "BLOB",
+		.fourcc = DRM_FORMAT_R8,
+		.num_planes = 1,
+		.bpp = { 1 },
+	},
+	{
+		/* the chroma stride is defined by graphics.h */
+		.format = HAL_PIXEL_FORMAT_YV12,
+		.name = "YV12",
+		.fourcc = DRM_FORMAT_YVU420,
+		.num_planes = 3,
+		.bpp = { 1, 1, 1 },
+		.hsub = 2,
+		.vsub = 2,
+		.align_w = 32,
+		.align_h = 2,
+		.chroma_align = 16,
+		.cb_plane = 2,
+		.cr_plane = 1,
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_YCbCr_422_SP,
+		.name = "YCbCr_422_SP",
+		.fourcc = DRM_FORMAT_NV16,
+		.num_planes = 2,
+		.bpp = { 1, 2 },
+		.hsub = 2,
+		.vsub = 1,
+		.align_w = 2,
+		.cb_plane = 1,
+		.cr_plane = 1,
+		.cr_offset = 1,
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_YCrCb_420_SP,
+		.name = "YCrCb_420_SP",
+		.fourcc = DRM_FORMAT_NV21,
+		.num_planes = 2,
+		.bpp = { 1, 2 },
+		.hsub = 2,
+		.vsub = 2,
+		.align_w = 2,
+		.align_h = 2,
+		.cb_plane = 1,
+		.cb_offset = 1,
+		.cr_plane = 1,
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_YCbCr_420_888,
+		.name = "YCbCr_420_888",
+		.fourcc = DRM_FORMAT_NV12,
+		.num_planes = 2,
+		.bpp = { 1, 2 },
+		.hsub = 2,
+		.vsub = 2,
+		.align_w = 2,
+		.align_h = 2,
+		.cb_plane = 1,
+		.cr_plane = 1,
+		.cr_offset = 1,
+	},
+	{
+		/* 10 bits in the high bits of 16-bit samples */
+		.format = HAL_PIXEL_FORMAT_YCBCR_P010,
+		.name = "YCBCR_P010",
+		.fourcc = DRM_FORMAT_P010,
+		.num_planes = 2,
+		.bpp = { 2, 4 },
+		.hsub = 2,
+		.vsub = 2,
+		.align_w = 2,
+		.align_h = 2,
+		.cb_plane = 1,
+		.cr_plane = 1,
+		.cr_offset = 2,
+	},
+	{
+		.format = HAL_PIXEL_FORMAT_DRM_NV12,
+		.name = "DRM_NV12",
+		.fourcc = DRM_FORMAT_NV12,
+		.num_planes = 2,
+		.bpp = { 1, 2 },
+		.hsub = 2,
+		.vsub = 2,
+		.align_w = 2,
+		.align_h = 2,
+		.cb_plane = 1,
+		.cr_plane = 1,
+		.cr_offset = 1,
+	},
+};
+
+#define FORMAT_COUNT (sizeof(gralloc_drm_formats) / sizeof(gralloc_drm_formats[0]))
+
+/*
+ * The HAL formats below 0x200 index the descriptors directly; the entries
+ * are offset by one so that 0 means none.
+ */
+#define FORMAT_INDEX_SIZE 0x200
+
+static uint8_t gralloc_drm_format_index[FORMAT_INDEX_SIZE];
+static const struct gralloc_drm_format *gralloc_drm_format_yv12;
+static pthread_once_t gralloc_drm_format_once = PTHREAD_ONCE_INIT;
+
+static void gralloc_drm_format_init_once(void)
+{
+	unsigned i;
+
+	for (i = 0; i < FORMAT_COUNT; i++) {
+		const struct gralloc_drm_format *desc = &gralloc_drm_formats[i];
+
+		if ((unsigned) desc->format < FORMAT_INDEX_SIZE)
+			gralloc_drm_format_index[desc->format] = i + 1;
+		else if (desc->format == HAL_PIXEL_FORMAT_YV12)
+			gralloc_drm_format_yv12 = desc;
+		else
+			ALOGE("format 0x%x cannot be indexed", desc->format);
+	}
+}
+
+/*
+ * Return the descriptor of a HAL format, or NULL if unsupported.
+ */
+const struct gralloc_drm_format *gralloc_drm_get_format(int format)
+{
+	unsigned idx;
+
+	pthread_once(&gralloc_drm_format_once, gralloc_drm_format_init_once);
+
+	if ((unsigned) format < FORMAT_INDEX_SIZE) {
+		idx = gralloc_drm_format_index[format];
+		return (idx) ? &gralloc_drm_formats[idx - 1] : NULL;
+	}
+
+	return (format == HAL_PIXEL_FORMAT_YV12) ?
+		gralloc_drm_format_yv12 : NULL;
+}
+
+/*
+ * Return all the descriptors and their count.
+ */
+int gralloc_drm_get_formats(const struct gralloc_drm_format **formats)
+{
+	*formats = gralloc_drm_formats;
+
+	return FORMAT_COUNT;
+}
+
+/*
+ * Resolve HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED to the format of a bo
+ * from its usage.  Camera and video encoder buffers that the GPU neither
+ * renders nor samples are NV12, half the size of RGBX.  The others, such
+ * as the GPU-rendered input surfaces of encoders, are RGBX, which GPUs
+ * render and sample and display engines scan out.  Other formats are
+ * returned unchanged.
+ */
+int gralloc_drm_get_alloc_format(int format, int usage)
+{
+	if (format != HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED)
+		return format;
+
+	if ((usage & (GRALLOC_USAGE_HW_CAMERA_MASK |
+		      GRALLOC_USAGE_HW_VIDEO_ENCODER)) &&
+	    !(usage & (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE)))
+		return HAL_PIXEL_FORMAT_YCbCr_420_888;
+
+	return HAL_PIXEL_FORMAT_RGBX_8888;
+}
+
+int gralloc_drm_get_bpp(int format)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+
+	return (desc) ? desc->bpp[0] : 0;
+}
+
+uint32_t gralloc_drm_get_fourcc(int format)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+
+	return (desc) ? desc->fourcc : 0;
+}
+
+unsigned int planes_for_format(struct gralloc_drm_t *drm, int hal_format)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(hal_format);
+
+	return (desc) ? desc->num_planes : 0;
+}
+
+/*
+ * Align the geometry of a bo, and add the rows of the chroma planes to the
+ * height.  The chroma planes take bpp[i] / (bpp[0] * hsub * vsub) rows of
+ * the first plane per row.
+ */
+void gralloc_drm_align_geometry(int format, int *width, int *height)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+	int chroma_bpp = 0, i;
+
+	if (!desc)
+		return;
+
+	if (desc->align_w)
+		*width = ALIGN(*width, desc->align_w);
+	if (desc->align_h)
+		*height = ALIGN(*height, desc->align_h);
+
+	for (i = 1; i < desc->num_planes; i++)
+		chroma_bpp += desc->bpp[i];
+
+	if (chroma_bpp)
+		*height += *height * chroma_bpp /
+			(desc->bpp[0] * desc->hsub * desc->vsub);
+}
+
+/*
+ * Compute the planes of a bo of a format whose first plane has stride
+ * bytes per row.  The rows and the bytes that gralloc_drm_align_geometry
+ * and a stride of at least 32-byte alignment allocate always hold them.
+ * Return the number of planes, or 0 for an unsupported format.
+ */
+int gralloc_drm_get_layout(int format, int height, int stride,
+		struct gralloc_drm_layout *layout)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+	int chroma_rows, i;
+	size_t size;
+
+	memset(layout, 0, sizeof(*layout));
+	if (!desc)
+		return 0;
+
+	layout->num_planes = desc->num_planes;
+	layout->strides[0] = stride;
+
+	size = (size_t) stride * height;
+	if (desc->num_planes > 1) {
+		chroma_rows = (height + desc->vsub - 1) / desc->vsub;
+
+		for (i = 1; i < desc->num_planes; i++) {
+			int chroma_stride = stride * desc->bpp[i] /
+				(desc->bpp[0] * desc->hsub);
+
+			if (desc->chroma_align)
+				chroma_stride = ALIGN(chroma_stride,
+						desc->chroma_align);
+
+			layout->offsets[i] = size;
+			layout->strides[i] = chroma_stride;
+			size += (size_t) chroma_stride * chroma_rows;
+		}
+
+		/* interleaved chroma steps over a Cb and Cr pair */
+		layout->chroma_step = desc->bpp[desc->cb_plane];
+		layout->cb_offset = layout->offsets[desc->cb_plane] +
+			desc->cb_offset;
+		layout->cr_offset = layout->offsets[desc->cr_plane] +
+			desc->cr_offset;
+	}
+
+	layout->size = size;
+	layout->rows = (stride) ? (size + stride - 1) / stride : height;
+
+	return layout->num_planes;
+}
@@ -50,6 +50,9 @@ struct gralloc_drm_handle_t {
 
 	int name;   /* the name of the bo */
 	int stride; /* the stride in bytes */
+	int heap;   /* allocated from a dma-buf heap rather than the GPU */
+	/* the DRM_FORMAT_MOD_* of the layout, or DRM_FORMAT_MOD_INVALID if implicit */
+	uint64_t modifier __attribute__((aligned(8)));
 
 	struct gralloc_drm_bo_t *data; /* pointer to struct gralloc_drm_bo_t */
 
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A driver for dma-buf heaps.  It allocates the bos that neither the GPU
+ * nor the display accesses, such as those of CPU, camera and video codec
+ * pipelines.  Bos are linear and mapped cached, with the CPU access
+ * bracketed with DMA_BUF_IOCTL_SYNC.
+ */
+
+#define LOG_TAG "GRALLOC-HEAP"
+
+#include <log/log.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+struct heap_info {
+	struct gralloc_drm_drv_t base;
+
+	int system_fd;   /* cached; -1 if the driver only imports */
+	int uncached_fd; /* -1 if there is none */
+};
+
+struct heap_buffer {
+	struct gralloc_drm_bo_t base;
+
+	void *ptr;
+	uint64_t sync; /* DMA_BUF_SYNC_* of the CPU access */
+};
+
+static void heap_destroy(struct gralloc_drm_drv_t *drv)
+{
+	struct heap_info *info = (struct heap_info *) drv;
+
+	if (info->uncached_fd >= 0)
+		close(info->uncached_fd);
+	if (info->system_fd >= 0)
+		close(info->system_fd);
+	free(info);
+}
+
+/* compute the pitch and the size of a handle */
+static int heap_get_layout(const struct gralloc_drm_handle_t *handle,
+		int *pitch, size_t *size)
+{
+	int cpp, aligned_width, aligned_height;
+
+	cpp = gralloc_drm_get_bpp(handle->format);
+	if (!cpp) {
+		ALOGE("unrecognized format 0x%x", handle->format);
+		return -EINVAL;
+	}
+
+	aligned_width = handle->width;
+	aligned_height = handle->height;
+	gralloc_drm_align_geometry(handle->format,
+			&aligned_width, &aligned_height);
+
+	/* a cache line, which codecs and ISPs are happy with */
+	*pitch = ALIGN(aligned_width * cpp, 64);
+	*size = (size_t) *pitch * aligned_height;
+
+	return 0;
+}
+
+/* return the heap to allocate a bo of the usage from */
+static int heap_get_fd(struct heap_info *info, int usage)
+{
+	/* only the CPU benefits from cached memory */
+	if (info->uncached_fd >= 0 &&
+	    (usage & GRALLOC_USAGE_SW_READ_MASK) != GRALLOC_USAGE_SW_READ_OFTEN &&
+	    (usage & GRALLOC_USAGE_SW_WRITE_MASK) != GRALLOC_USAGE_SW_WRITE_OFTEN)
+		return info->uncached_fd;
+
+	return info->system_fd;
+}
+
+static struct gralloc_drm_bo_t *heap_alloc(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct heap_info *info = (struct heap_info *) drv;
+	struct heap_buffer *buf;
+	size_t size;
+	int pitch;
+
+	if (heap_get_layout(handle, &pitch, &size))
+		return NULL;
+
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	if (handle->prime_fd >= 0) {
+		off_t end = lseek(handle->prime_fd, 0, SEEK_END);
+
+		if (end > 0)
+			size = (size_t) end;
+	}
+	else if (info->system_fd < 0) {
+		ALOGE("no dma-buf heap to allocate from");
+		free(buf);
+		return NULL;
+	}
+	else {
+		struct dma_heap_allocation_data data;
+
+		/* round up so that the bo can be re-described */
+		memset(&data, 0, sizeof(data));
+		data.len = gralloc_drm_size_class(size);
+		data.fd_flags = O_RDWR | O_CLOEXEC;
+
+		if (ioctl(heap_get_fd(info, handle->usage),
+					DMA_HEAP_IOCTL_ALLOC, &data)) {
+			ALOGE("failed to allocate %zu bytes from heap: %d",
+					(size_t) data.len, -errno);
+			free(buf);
+			return NULL;
+		}
+
+		handle->prime_fd = data.fd;
+		handle->stride = pitch;
+		size = data.len;
+	}
+
+	handle->name = 0;
+
+	/* heaps hand out zeroed pages, so needs_clear is left unset */
+	buf->base.size = size;
+	buf->base.handle = handle;
+
+	return &buf->base;
+}
+
+static void heap_free(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct heap_buffer *buf = (struct heap_buffer *) bo;
+
+	/* the prime fd of an imported handle belongs to its owner */
+	if (!bo->imported && bo->handle->prime_fd >= 0) {
+		close(bo->handle->prime_fd);
+		bo->handle->prime_fd = -1;
+	}
+
+	free(buf);
+}
+
+static int heap_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write)
+{
+	struct heap_buffer *buf = (struct heap_buffer *) bo;
+
+	/* the uAPI has no ranges */
+	buf->sync = (enable_write) ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ;
+
+	return gralloc_drm_dmabuf_sync(bo->handle->prime_fd,
+			DMA_BUF_SYNC_START | buf->sync);
+}
+
+static void heap_end_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct heap_buffer *buf = (struct heap_buffer *) bo;
+
+	/* kept mappings are unmapped outside of CPU access too */
+	if (!buf->sync)
+		return;
+
+	gralloc_drm_dmabuf_sync(bo->handle->prime_fd,
+			DMA_BUF_SYNC_END | buf->sync);
+	buf->sync = 0;
+}
+
+static int heap_map(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write, void **addr)
+{
+	struct heap_buffer *buf = (struct heap_buffer *) bo;
+	void *ptr;
+	int err;
+
+	ptr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			bo->handle->prime_fd, 0);
+	if (ptr == MAP_FAILED) {
+		ALOGE("failed to map dma-buf %d: %d",
+				bo->handle->prime_fd, -errno);
+		return -errno;
+	}
+
+	err = heap_begin_cpu_access(drv, bo, x, y, w, h, enable_write);
+	if (err) {
+		munmap(ptr, bo->size);
+		return err;
+	}
+
+	buf->ptr = ptr;
+	*addr = ptr;
+
+	return 0;
+}
+
+static void heap_unmap(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct heap_buffer *buf = (struct heap_buffer *) bo;
+
+	heap_end_cpu_access(drv, bo);
+	munmap(buf->ptr, bo->size);
+	buf->ptr = NULL;
+}
+
+static int heap_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	size_t size;
+	int pitch;
+
+	if (heap_get_layout(handle, &pitch, &size) ||
+	    !gralloc_drm_size_class_match(size, bo->size))
+		return -EINVAL;
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
+}
+
+/*
+ * Create the driver.  Unless alloc is true, it only imports the bos that
+ * other processes allocated from the heaps.  With alloc true, there is no
+ * driver when there are no heaps.
+ */
+struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_heap(int alloc)
+{
+	struct heap_info *info;
+
+	info = calloc(1, sizeof(*info));
+	if (!info)
+		return NULL;
+
+	info->system_fd = -1;
+	info->uncached_fd = -1;
+
+	if (alloc) {
+		info->system_fd = open("/dev/dma_heap/system",
+				O_RDONLY | O_CLOEXEC);
+		if (info->system_fd < 0) {
+			ALOGI("no dma-buf heaps, all bos are from the GPU driver");
+			free(info);
+			return NULL;
+		}
+
+		info->uncached_fd = open("/dev/dma_heap/system-uncached",
+				O_RDONLY | O_CLOEXEC);
+	}
+
+	info->base.destroy = heap_destroy;
+	info->base.alloc = heap_alloc;
+	info->base.free = heap_free;
+	info->base.map = heap_map;
+	info->base.unmap = heap_unmap;
+	info->base.begin_cpu_access = heap_begin_cpu_access;
+	info->base.end_cpu_access = heap_end_cpu_access;
+	info->base.redescribe = heap_redescribe;
+
+	return &info->base;
+}
@@ -36,6 +36,7 @@
 #include <drm.h>
 #include <intel_bufmgr.h>
 #include <i915_drm.h>
+#include <drm_fourcc.h>
 
 #include "gralloc_drm.h"
 #include "gralloc_drm_formats.h"
@@ -70,6 +71,7 @@ struct intel_buffer {
 	struct gralloc_drm_bo_t base;
 	drm_intel_bo *ibo;
 	uint32_t tiling;
+	int cpu_write; /* written through a kept CPU mapping */
 };
 
 static int
@@ -203,40 +205,40 @@ static void intel_resolve_format(struct gralloc_drm_drv_t *drv,
 	 */
 
 	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct gralloc_drm_layout layout;
+	int i;
 
 	memset(pitches, 0, 4 * sizeof(uint32_t));
 	memset(offsets, 0, 4 * sizeof(uint32_t));
 	memset(handles, 0, 4 * sizeof(uint32_t));
 
-	pitches[0] = ib->base.handle->stride;
-	handles[0] = ib->base.fb_handle;
+	/* the planes of YV12 are in YVU420 order */
+	gralloc_drm_get_layout(ib->base.handle->format,
+			ib->base.handle->height, ib->base.handle->stride,
+			&layout);
 
-	switch(ib->base.handle->format) {
-		case HAL_PIXEL_FORMAT_YV12:
-
-			// U and V stride are half of Y plane
-			pitches[2] = pitches[0]/2;
-			pitches[1] = pitches[0]/2;
-
-			// like I420 but U and V are in reverse order
-			offsets[2] = offsets[0] +
-				pitches[0] * ib->base.handle->height;
-			offsets[1] = offsets[2] +
-				pitches[2] * ib->base.handle->height/2;
-
-			handles[1] = handles[2] = handles[0];
-			break;
+	for (i = 0; i < layout.num_planes; i++) {
+		pitches[i] = layout.strides[i];
+		offsets[i] = layout.offsets[i];
+		handles[i] = ib->base.fb_handle;
+	}
+}
 
-		case HAL_PIXEL_FORMAT_DRM_NV12:
+static uint32_t get_tiling(const struct gralloc_drm_handle_t *handle)
+{
+	uint32_t tiling;
 
-			// U and V are interleaved in 2nd plane
-			pitches[1] = pitches[0];
-			offsets[1] = offsets[0] +
-				pitches[0] * ib->base.handle->height;
+	if (handle->usage & (GRALLOC_USAGE_SW_READ_OFTEN |
+			     GRALLOC_USAGE_SW_WRITE_OFTEN))
+		tiling = I915_TILING_NONE;
+	else if ((handle->usage & GRALLOC_USAGE_HW_RENDER) ||
+		 ((handle->usage & GRALLOC_USAGE_HW_TEXTURE) &&
+		  handle->width >= 64))
+		tiling = I915_TILING_X;
+	else
+		tiling = I915_TILING_NONE;
 
-			handles[1] = handles[0];
-			break;
-	}
+	return tiling;
 }
 
 static drm_intel_bo *alloc_ibo(struct intel_info *info,
@@ -305,15 +307,7 @@ static drm_intel_bo *alloc_ibo(struct intel_info *info,
 		}
 	}
 	else {
-		if (handle->usage & (GRALLOC_USAGE_SW_READ_OFTEN |
-				     GRALLOC_USAGE_SW_WRITE_OFTEN))
-			*tiling = I915_TILING_NONE;
-		else if ((handle->usage & GRALLOC_USAGE_HW_RENDER) ||
-			 ((handle->usage & GRALLOC_USAGE_HW_TEXTURE) &&
-			  handle->width >= 64))
-			*tiling = I915_TILING_X;
-		else
-			*tiling = I915_TILING_NONE;
+		*tiling = get_tiling(handle);
 
 		if (handle->usage & GRALLOC_USAGE_HW_TEXTURE) {
 			name = "gralloc-texture";
@@ -379,6 +373,8 @@ static struct gralloc_drm_bo_t *intel_alloc(struct gralloc_drm_drv_t *drv,
 		}
 
 		handle->stride = stride;
+		handle->modifier = (ib->tiling == I915_TILING_X) ?
+			I915_FORMAT_MOD_X_TILED : DRM_FORMAT_MOD_LINEAR;
 
 		if (drm_intel_bo_flink(ib->ibo, (uint32_t *) &handle->name)) {
 			ALOGE("failed to flink ibo");
@@ -389,12 +385,53 @@ static struct gralloc_drm_bo_t *intel_alloc(struct gralloc_drm_drv_t *drv,
 	}
 
 	ib->base.fb_handle = ib->ibo->handle;
+	ib->base.size = ib->ibo->size;
 
 	ib->base.handle = handle;
 
 	return &ib->base;
 }
 
+static int intel_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	int aligned_width, aligned_height, bpp;
+	unsigned long stride;
+
+	/* only linear bos can change their stride without a fence update */
+	if (ib->tiling != I915_TILING_NONE ||
+	    (handle->usage & GRALLOC_USAGE_HW_FB) ||
+	    get_tiling(handle) != I915_TILING_NONE)
+		return -EINVAL;
+
+	bpp = gralloc_drm_get_bpp(handle->format);
+	if (!bpp)
+		return -EINVAL;
+
+	aligned_width = handle->width;
+	aligned_height = handle->height;
+	gralloc_drm_align_geometry(handle->format,
+			&aligned_width, &aligned_height);
+	if (handle->usage & GRALLOC_USAGE_HW_TEXTURE) {
+		aligned_width = ALIGN(aligned_width, 4);
+		aligned_height = ALIGN(aligned_height, 2);
+	}
+
+	/* as drm_intel_bo_alloc_tiled does for linear bos */
+	stride = ALIGN(aligned_width * bpp, 64);
+	if (!gralloc_drm_size_class_match(stride * aligned_height,
+				ib->ibo->size))
+		return -EINVAL;
+
+	handle->stride = stride;
+	handle->modifier = DRM_FORMAT_MOD_LINEAR;
+	bo->handle = handle;
+
+	return 0;
+}
+
 static void intel_free(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_bo_t *bo)
 {
@@ -417,8 +454,10 @@ static int intel_map(struct gralloc_drm_drv_t *drv,
 		err = drm_intel_gem_bo_map_gtt(ib->ibo);
 	else
 		err = drm_intel_bo_map(ib->ibo, enable_write);
-	if (!err)
+	if (!err) {
 		*addr = ib->ibo->virtual;
+		ib->cpu_write = enable_write;
+	}
 
 	return err;
 }
@@ -435,6 +474,74 @@ static void intel_unmap(struct gralloc_drm_drv_t *drv,
 		drm_intel_bo_unmap(ib->ibo);
 }
 
+static int intel_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int enable_write)
+{
+	struct intel_info *info = (struct intel_info *) drv;
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct drm_i915_gem_set_domain set_domain;
+
+	if (ib->tiling != I915_TILING_NONE ||
+	    (ib->base.handle->usage & GRALLOC_USAGE_HW_FB)) {
+		drm_intel_gem_bo_start_gtt_access(ib->ibo, enable_write);
+		return 0;
+	}
+
+	/* what drm_intel_bo_map does besides mapping */
+	memset(&set_domain, 0, sizeof(set_domain));
+	set_domain.handle = ib->ibo->handle;
+	set_domain.read_domains = I915_GEM_DOMAIN_CPU;
+	set_domain.write_domain = (enable_write) ? I915_GEM_DOMAIN_CPU : 0;
+	if (drmIoctl(info->fd, DRM_IOCTL_I915_GEM_SET_DOMAIN, &set_domain)) {
+		ALOGE("failed to set cpu domain");
+		return -errno;
+	}
+
+	ib->cpu_write = enable_write;
+
+	return 0;
+}
+
+static int intel_busy(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int write, int wait)
+{
+	struct intel_info *info = (struct intel_info *) drv;
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct drm_i915_gem_busy busy;
+
+	if (wait)
+		return drm_intel_gem_bo_wait(ib->ibo, -1);
+
+	memset(&busy, 0, sizeof(busy));
+	busy.handle = ib->ibo->handle;
+	if (drmIoctl(info->fd, DRM_IOCTL_I915_GEM_BUSY, &busy))
+		return -errno;
+
+	/* readers wait only for the writing engine, in the low word */
+	if (write)
+		return (busy.busy) ? -EBUSY : 0;
+	else
+		return (busy.busy & 0xffff) ? -EBUSY : 0;
+}
+
+static void intel_end_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct intel_info *info = (struct intel_info *) drv;
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct drm_i915_gem_sw_finish sw_finish;
+
+	if (!ib->cpu_write)
+		return;
+
+	/* flush CPU writes for scanout */
+	memset(&sw_finish, 0, sizeof(sw_finish));
+	sw_finish.handle = ib->ibo->handle;
+	drmIoctl(info->fd, DRM_IOCTL_I915_GEM_SW_FINISH, &sw_finish);
+	ib->cpu_write = 0;
+}
+
 #include "intel_chipset.h" /* for platform detection macros */
 static void gen_init(struct intel_info *info)
 {
@@ -505,7 +612,13 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_intel(int fd)
 	info->base.free = intel_free;
 	info->base.map = intel_map;
 	info->base.unmap = intel_unmap;
+	info->base.begin_cpu_access = intel_begin_cpu_access;
+	info->base.end_cpu_access = intel_end_cpu_access;
+	info->base.busy = intel_busy;
 	info->base.resolve_format = intel_resolve_format;
+	info->base.redescribe = intel_redescribe;
+	/* tiled bos are mapped through the fenced GTT */
+	info->base.tiled_mappable = 1;
 
 	return &info->base;
 }
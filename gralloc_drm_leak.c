@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Registry of the live bos, to find the buffers a process keeps alive.
+ * When gralloc.drm.leak_track is set, every bo created or imported is
+ * recorded with the process it came from, the creating or importing
+ * thread, a short backtrace, and its size.  Locks update the time of the
+ * last lock.  A thread reports the bos idle for gralloc.drm.leak_idle_s
+ * every gralloc.drm.leak_report_s seconds.
+ */
+
+#define LOG_TAG "GRALLOC-LEAK"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <unwind.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+#define LEAK_FRAMES 12
+#define LEAK_REPORT_MAX 16 /* bos logged per report */
+
+struct gralloc_drm_leak_entry {
+	struct gralloc_drm_leak_entry *prev, *next;
+	struct gralloc_drm_bo_t *bo;
+
+	int imported;
+	int32_t pid; /* creating process, or the one that sent an import */
+	int32_t tid; /* creating or importing thread */
+	int64_t size;
+	int64_t create_time;
+	int64_t lock_time; /* atomic, 0 if never locked */
+
+	int depth;
+	uintptr_t frames[LEAK_FRAMES];
+};
+
+struct gralloc_drm_leak_table {
+	pthread_mutex_t mutex;
+	struct gralloc_drm_leak_entry *head, *tail; /* oldest first */
+	int count;
+	int64_t bytes;
+
+	int64_t idle_ns;
+	int64_t report_ns;
+
+	/* reports idle bos, see leak_report_worker */
+	pthread_t thread;
+	pthread_cond_t cond;
+	int running;
+	int quit;
+};
+
+struct leak_unwind {
+	uintptr_t *frames;
+	int depth;
+	int skip;
+};
+
+static _Unwind_Reason_Code leak_unwind_frame(struct _Unwind_Context *ctx,
+		void *arg)
+{
+	struct leak_unwind *u = (struct leak_unwind *) arg;
+	uintptr_t ip = _Unwind_GetIP(ctx);
+
+	if (!ip)
+		return _URC_END_OF_STACK;
+
+	if (u->skip) {
+		u->skip--;
+		return _URC_NO_REASON;
+	}
+
+	u->frames[u->depth++] = ip;
+
+	return (u->depth < LEAK_FRAMES) ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+/*
+ * Record the return addresses of the callers of gralloc_drm_leak_track.
+ */
+static int __attribute__((noinline)) leak_backtrace(uintptr_t *frames)
+{
+	/* this function and gralloc_drm_leak_track */
+	struct leak_unwind u = { frames, 0, 2 };
+
+	_Unwind_Backtrace(leak_unwind_frame, &u);
+
+	return u.depth;
+}
+
+/*
+ * Describe a return address as library+offset (symbol).
+ */
+static void leak_format_frame(uintptr_t ip, char *buf, int len)
+{
+	Dl_info info;
+	const char *lib;
+
+	if (!dladdr((void *) ip, &info) || !info.dli_fname) {
+		snprintf(buf, len, "%#lx", (unsigned long) ip);
+		return;
+	}
+
+	lib = strrchr(info.dli_fname, '/');
+	lib = (lib) ? lib + 1 : info.dli_fname;
+
+	if (info.dli_sname)
+		snprintf(buf, len, "%s+%#lx (%s+%#lx)", lib,
+				(unsigned long) (ip - (uintptr_t) info.dli_fbase),
+				info.dli_sname,
+				(unsigned long) (ip - (uintptr_t) info.dli_saddr));
+	else
+		snprintf(buf, len, "%s+%#lx", lib,
+				(unsigned long) (ip - (uintptr_t) info.dli_fbase));
+}
+
+/*
+ * Return the time since the last use of a bo: its last lock, or its
+ * creation when never locked.
+ */
+static int64_t leak_get_idle(const struct gralloc_drm_leak_entry *entry,
+		int64_t now)
+{
+	int64_t last = __atomic_load_n(&entry->lock_time, __ATOMIC_RELAXED);
+
+	return now - ((last) ? last : entry->create_time);
+}
+
+/*
+ * Log the bos idle past the threshold, largest first.  The table mutex
+ * must be held.
+ */
+static void leak_report_locked(struct gralloc_drm_leak_table *table)
+{
+	struct gralloc_drm_leak_entry idle[LEAK_REPORT_MAX];
+	struct gralloc_drm_leak_entry *entry;
+	int64_t now = gralloc_drm_get_time(), idle_bytes = 0;
+	int idle_count = 0, n = 0, i, j;
+	char frame[128];
+
+	for (entry = table->head; entry; entry = entry->next) {
+		if (leak_get_idle(entry, now) < table->idle_ns)
+			continue;
+
+		idle_count++;
+		idle_bytes += entry->size;
+
+		/* keep the largest */
+		for (i = n; i > 0 && idle[i - 1].size < entry->size; i--)
+			;
+		if (i >= LEAK_REPORT_MAX)
+			continue;
+		if (n < LEAK_REPORT_MAX)
+			n++;
+		for (j = n - 1; j > i; j--)
+			idle[j] = idle[j - 1];
+		idle[i] = *entry;
+	}
+
+	if (!idle_count)
+		return;
+
+	ALOGW("%d of %d live bos (%lld of %lld bytes) idle for %lld s or more",
+			idle_count, table->count, (long long) idle_bytes,
+			(long long) table->bytes,
+			(long long) (table->idle_ns / 1000000000));
+
+	for (i = 0; i < n; i++) {
+		const struct gralloc_drm_leak_entry *e = &idle[i];
+
+		ALOGW("  bo %p %dx%d format 0x%x usage 0x%x, %lld bytes, "
+				"%s by pid %d tid %d, idle %lld s",
+				(void *) e->bo, e->bo->handle->width,
+				e->bo->handle->height, e->bo->handle->format,
+				e->bo->handle->usage, (long long) e->size,
+				(e->imported) ? "imported" : "created",
+				e->pid, e->tid,
+				(long long) (leak_get_idle(e, now) / 1000000000));
+
+		for (j = 0; j < e->depth; j++) {
+			leak_format_frame(e->frames[j], frame, sizeof(frame));
+			ALOGW("    #%d %s", j, frame);
+		}
+	}
+}
+
+static void *leak_report_worker(void *arg)
+{
+	struct gralloc_drm_leak_table *table =
+		(struct gralloc_drm_leak_table *) arg;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&table->mutex);
+	while (!table->quit) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += table->report_ns / 1000000000;
+
+		pthread_cond_timedwait(&table->cond, &table->mutex, &deadline);
+		if (table->quit)
+			break;
+
+		leak_report_locked(table);
+	}
+	pthread_mutex_unlock(&table->mutex);
+
+	return NULL;
+}
+
+void gralloc_drm_leak_init(struct gralloc_drm_t *drm)
+{
+	char value[PROPERTY_VALUE_MAX];
+	struct gralloc_drm_leak_table *table;
+	pthread_condattr_t attr;
+	int report_s;
+
+	property_get("gralloc.drm.leak_track", value, "0");
+	if (!atoi(value))
+		return;
+
+	table = calloc(1, sizeof(*table));
+	if (!table)
+		return;
+
+	pthread_mutex_init(&table->mutex, NULL);
+
+	property_get("gralloc.drm.leak_idle_s", value, "60");
+	table->idle_ns = (int64_t) atoi(value) * 1000000000;
+
+	/* a zero period disables the reports */
+	property_get("gralloc.drm.leak_report_s", value, "60");
+	report_s = atoi(value);
+	table->report_ns = (int64_t) report_s * 1000000000;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&table->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (report_s > 0) {
+		if (!pthread_create(&table->thread, NULL, leak_report_worker,
+					table))
+			table->running = 1;
+		else
+			ALOGE("failed to create leak report thread");
+	}
+
+	drm->leaks = table;
+
+	ALOGI("tracking live bos, reporting those idle for %lld s",
+			(long long) (table->idle_ns / 1000000000));
+}
+
+void gralloc_drm_leak_fini(struct gralloc_drm_t *drm)
+{
+	struct gralloc_drm_leak_table *table = drm->leaks;
+	struct gralloc_drm_leak_entry *entry, *next;
+
+	if (!table)
+		return;
+
+	if (table->running) {
+		pthread_mutex_lock(&table->mutex);
+		table->quit = 1;
+		pthread_cond_signal(&table->cond);
+		pthread_mutex_unlock(&table->mutex);
+
+		pthread_join(table->thread, NULL);
+	}
+
+	for (entry = table->head; entry; entry = next) {
+		next = entry->next;
+		entry->bo->leak = NULL;
+		free(entry);
+	}
+
+	pthread_cond_destroy(&table->cond);
+	pthread_mutex_destroy(&table->mutex);
+	free(table);
+	drm->leaks = NULL;
+}
+
+/*
+ * Record a bo that is created, or imported from the process pid.
+ */
+void gralloc_drm_leak_track(struct gralloc_drm_bo_t *bo, int pid)
+{
+	struct gralloc_drm_leak_table *table = bo->drm->leaks;
+	struct gralloc_drm_leak_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return;
+
+	entry->bo = bo;
+	entry->imported = bo->imported;
+	entry->pid = pid;
+	entry->tid = gettid();
+	entry->size = gralloc_drm_bo_get_size(bo);
+	entry->create_time = gralloc_drm_get_time();
+	entry->depth = leak_backtrace(entry->frames);
+
+	pthread_mutex_lock(&table->mutex);
+
+	entry->prev = table->tail;
+	if (table->tail)
+		table->tail->next = entry;
+	else
+		table->head = entry;
+	table->tail = entry;
+
+	table->count++;
+	table->bytes += entry->size;
+
+	bo->leak = entry;
+
+	pthread_mutex_unlock(&table->mutex);
+}
+
+/*
+ * Forget a bo that is destroyed or goes back to the cache.
+ */
+void gralloc_drm_leak_untrack(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_leak_table *table = bo->drm->leaks;
+	struct gralloc_drm_leak_entry *entry = bo->leak;
+
+	if (!entry)
+		return;
+
+	pthread_mutex_lock(&table->mutex);
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		table->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		table->tail = entry->prev;
+
+	table->count--;
+	table->bytes -= entry->size;
+
+	bo->leak = NULL;
+
+	pthread_mutex_unlock(&table->mutex);
+
+	free(entry);
+}
+
+/*
+ * Note a lock of a tracked bo.
+ */
+void gralloc_drm_leak_lock(struct gralloc_drm_bo_t *bo)
+{
+	__atomic_store_n(&bo->leak->lock_time, gralloc_drm_get_time(),
+			__ATOMIC_RELAXED);
+}
+
+/*
+ * Describe the live bos in buf, oldest first.  Return the length of the
+ * text, which is truncated to len - 1 bytes.
+ */
+int gralloc_drm_dump_buffers(struct gralloc_drm_t *drm, char *buf, int len)
+{
+	struct gralloc_drm_leak_table *table = drm->leaks;
+	struct gralloc_drm_leak_entry *entry;
+	struct gralloc_drm_dump_buf lb = { buf, len, 0 };
+	int64_t now = gralloc_drm_get_time();
+	char frame[128];
+	int i;
+
+	if (len <= 0)
+		return -EINVAL;
+	buf[0] = '\0';
+
+	if (!table)
+		return -EINVAL;
+
+	pthread_mutex_lock(&table->mutex);
+
+	gralloc_drm_dump_printf(&lb, "live bos: %d, %lld bytes\n", table->count,
+			(long long) table->bytes);
+
+	for (entry = table->head; entry && lb.pos < len; entry = entry->next) {
+		const struct gralloc_drm_handle_t *handle = entry->bo->handle;
+		int64_t lock_time = __atomic_load_n(&entry->lock_time,
+				__ATOMIC_RELAXED);
+
+		gralloc_drm_dump_printf(&lb,
+				"  bo %p %dx%d format 0x%x usage 0x%x, "
+				"%lld bytes, %s by pid %d tid %d, age %lld ms, ",
+				(void *) entry->bo, handle->width,
+				handle->height, handle->format, handle->usage,
+				(long long) entry->size,
+				(entry->imported) ? "imported" : "created",
+				entry->pid, entry->tid,
+				(long long) ((now - entry->create_time) / 1000000));
+		if (lock_time)
+			gralloc_drm_dump_printf(&lb, "locked %lld ms ago\n",
+					(long long) ((now - lock_time) / 1000000));
+		else
+			gralloc_drm_dump_printf(&lb, "never locked\n");
+
+		for (i = 0; i < entry->depth; i++) {
+			leak_format_frame(entry->frames[i], frame,
+					sizeof(frame));
+			gralloc_drm_dump_printf(&lb, "    #%d %s\n", i, frame);
+		}
+	}
+
+	pthread_mutex_unlock(&table->mutex);
+
+	return gralloc_drm_dump_length(&lb);
+}
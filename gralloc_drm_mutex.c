@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Contention accounting of the internal mutexes.  When
+ * gralloc.drm.lock_profile is set, a lock first tries the mutex and, when
+ * held, records its holder and times the wait; an unlock times the hold.
+ * Both are accounted per mutex and per call site while the mutex is held,
+ * so the accounting takes no other lock.  The holder is the only writer
+ * of the counters and updates them atomically, which lets the snapshot
+ * read them without the mutex.  Without the property, a lock is a plain
+ * pthread_mutex_lock behind one predicted branch.
+ */
+
+#define LOG_TAG "GRALLOC-MUTEX"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+int gralloc_drm_mutex_profiling;
+
+/* the mutexes locked with the accounting, see mutex_register */
+static pthread_mutex_t mutex_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct gralloc_drm_mutex *mutex_list;
+
+static pthread_once_t mutex_once = PTHREAD_ONCE_INIT;
+
+static void mutex_profile_init_once(void)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	property_get("gralloc.drm.lock_profile", value, "0");
+	if (!atoi(value))
+		return;
+
+	ALOGI("profiling mutex contention");
+	__atomic_store_n(&gralloc_drm_mutex_profiling, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Read gralloc.drm.lock_profile.  Called by gralloc_drm_create.
+ */
+void gralloc_drm_mutex_profile_init(void)
+{
+	pthread_once(&mutex_once, mutex_profile_init_once);
+}
+
+void gralloc_drm_mutex_init(struct gralloc_drm_mutex *m, const char *name)
+{
+	memset(m, 0, sizeof(*m));
+	pthread_mutex_init(&m->mutex, NULL);
+	m->name = name;
+}
+
+void gralloc_drm_mutex_destroy(struct gralloc_drm_mutex *m)
+{
+	struct gralloc_drm_mutex **p;
+
+	if (m->registered) {
+		pthread_mutex_lock(&mutex_list_mutex);
+		for (p = &mutex_list; *p; p = &(*p)->next) {
+			if (*p == m) {
+				*p = m->next;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&mutex_list_mutex);
+	}
+
+	pthread_mutex_destroy(&m->mutex);
+}
+
+/*
+ * List a mutex on its first lock with the accounting.  Other mutexes may
+ * be held, as the snapshot takes no mutex but the list mutex.
+ */
+static void mutex_register(struct gralloc_drm_mutex *m)
+{
+	pthread_mutex_lock(&mutex_list_mutex);
+	if (!m->registered) {
+		strncpy(m->stats.name, m->name, sizeof(m->stats.name) - 1);
+		m->next = mutex_list;
+		mutex_list = m;
+		__atomic_store_n(&m->registered, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&mutex_list_mutex);
+}
+
+/* add to a counter, which only the holder of the mutex writes */
+static inline void mutex_stat_add(int64_t *stat, int64_t val)
+{
+	__atomic_store_n(stat, __atomic_load_n(stat, __ATOMIC_RELAXED) + val,
+			__ATOMIC_RELAXED);
+}
+
+static inline int64_t mutex_stat_read(const int64_t *stat)
+{
+	return __atomic_load_n(stat, __ATOMIC_RELAXED);
+}
+
+/*
+ * Return the counters of a call site, or NULL when the sites are all
+ * taken.  The mutex must be held.  A site is published after its key, so
+ * that the snapshot finds the key of every site it counts.
+ */
+static struct gralloc_drm_lock_site *mutex_get_site(
+		struct gralloc_drm_mutex *m, const char *site)
+{
+	struct gralloc_drm_lock_stats *stats = &m->stats;
+	int i;
+
+	for (i = 0; i < stats->site_count; i++) {
+		if (m->site_keys[i] == site)
+			return &stats->sites[i];
+	}
+
+	if (stats->site_count >= GRALLOC_DRM_LOCK_SITES)
+		return NULL;
+
+	__atomic_store_n(&m->site_keys[i], site, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->site_count, i + 1, __ATOMIC_RELEASE);
+
+	return &stats->sites[i];
+}
+
+static void mutex_copy_site(char *dst, size_t size, const char *site)
+{
+	strncpy(dst, (site) ? site : "?", size - 1);
+	dst[size - 1] = '\0';
+}
+
+void gralloc_drm_mutex_lock_profiled(struct gralloc_drm_mutex *m,
+		const char *site)
+{
+	struct gralloc_drm_lock_stats *stats = &m->stats;
+	struct gralloc_drm_lock_site *s;
+	int32_t tid = gettid(), owner = 0;
+	const char *owner_site = NULL;
+	int64_t start, wait = -1;
+
+	if (!__atomic_load_n(&m->registered, __ATOMIC_ACQUIRE))
+		mutex_register(m);
+
+	if (pthread_mutex_trylock(&m->mutex)) {
+		/* racy, but only informative */
+		owner = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+		owner_site = __atomic_load_n(&m->owner_site, __ATOMIC_RELAXED);
+
+		start = gralloc_drm_get_time();
+		pthread_mutex_lock(&m->mutex);
+		wait = gralloc_drm_get_time() - start;
+	}
+
+	__atomic_store_n(&m->owner, tid, __ATOMIC_RELAXED);
+	__atomic_store_n(&m->owner_site, site, __ATOMIC_RELAXED);
+	m->acquired = gralloc_drm_get_time();
+
+	mutex_stat_add(&stats->locks, 1);
+	if (wait >= 0) {
+		mutex_stat_add(&stats->contentions, 1);
+		mutex_stat_add(&stats->wait_ns, wait);
+		if (stats->max_wait_ns < wait) {
+			__atomic_store_n(&stats->max_wait_ns, wait,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&stats->max_wait_tid, tid,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&stats->max_wait_owner_tid, owner,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&m->max_wait_site, site,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&m->max_wait_owner_site, owner_site,
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	s = mutex_get_site(m, site);
+	if (s) {
+		mutex_stat_add(&s->locks, 1);
+		if (wait >= 0) {
+			mutex_stat_add(&s->contentions, 1);
+			mutex_stat_add(&s->wait_ns, wait);
+		}
+	}
+}
+
+/*
+ * Account the hold that ends now.  The mutex must be held.
+ */
+static void mutex_end_hold(struct gralloc_drm_mutex *m)
+{
+	struct gralloc_drm_lock_stats *stats = &m->stats;
+	struct gralloc_drm_lock_site *s;
+	int64_t hold = gralloc_drm_get_time() - m->acquired;
+
+	mutex_stat_add(&stats->hold_ns, hold);
+	if (stats->max_hold_ns < hold) {
+		__atomic_store_n(&stats->max_hold_ns, hold, __ATOMIC_RELAXED);
+		__atomic_store_n(&m->max_hold_site, m->owner_site,
+				__ATOMIC_RELAXED);
+	}
+
+	s = mutex_get_site(m, m->owner_site);
+	if (s)
+		mutex_stat_add(&s->hold_ns, hold);
+
+	__atomic_store_n(&m->owner, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&m->owner_site, NULL, __ATOMIC_RELAXED);
+	m->acquired = 0;
+}
+
+void gralloc_drm_mutex_unlock_profiled(struct gralloc_drm_mutex *m)
+{
+	mutex_end_hold(m);
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/*
+ * Wait for a condition.  The sleep is not a hold, and reacquiring the
+ * mutex after the wake-up is not counted as a lock.
+ */
+void gralloc_drm_mutex_cond_wait_at(pthread_cond_t *cond,
+		struct gralloc_drm_mutex *m, const char *site)
+{
+	int profiled = (m->acquired != 0);
+
+	if (profiled)
+		mutex_end_hold(m);
+
+	pthread_cond_wait(cond, &m->mutex);
+
+	if (profiled) {
+		__atomic_store_n(&m->owner, gettid(), __ATOMIC_RELAXED);
+		__atomic_store_n(&m->owner_site, site, __ATOMIC_RELAXED);
+		m->acquired = gralloc_drm_get_time();
+	}
+}
+
+/*
+ * Copy the accounting of a mutex, which may be held meanwhile.  Each
+ * counter is read atomically, but the counters may be a few locks apart,
+ * and the longest wait or hold may be paired with the site of the next
+ * longest one.
+ */
+static void mutex_snapshot(const struct gralloc_drm_mutex *m,
+		struct gralloc_drm_lock_stats *stats)
+{
+	const struct gralloc_drm_lock_stats *src = &m->stats;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	memcpy(stats->name, src->name, sizeof(stats->name));
+
+	stats->locks = mutex_stat_read(&src->locks);
+	stats->contentions = mutex_stat_read(&src->contentions);
+	stats->wait_ns = mutex_stat_read(&src->wait_ns);
+	stats->hold_ns = mutex_stat_read(&src->hold_ns);
+
+	stats->max_wait_ns = mutex_stat_read(&src->max_wait_ns);
+	if (stats->max_wait_ns) {
+		stats->max_wait_tid = __atomic_load_n(&src->max_wait_tid,
+				__ATOMIC_RELAXED);
+		stats->max_wait_owner_tid = __atomic_load_n(
+				&src->max_wait_owner_tid, __ATOMIC_RELAXED);
+		mutex_copy_site(stats->max_wait_site,
+				sizeof(stats->max_wait_site),
+				__atomic_load_n(&m->max_wait_site,
+					__ATOMIC_RELAXED));
+		mutex_copy_site(stats->max_wait_owner_site,
+				sizeof(stats->max_wait_owner_site),
+				__atomic_load_n(&m->max_wait_owner_site,
+					__ATOMIC_RELAXED));
+	}
+
+	stats->max_hold_ns = mutex_stat_read(&src->max_hold_ns);
+	if (stats->max_hold_ns) {
+		mutex_copy_site(stats->max_hold_site,
+				sizeof(stats->max_hold_site),
+				__atomic_load_n(&m->max_hold_site,
+					__ATOMIC_RELAXED));
+	}
+
+	stats->site_count = __atomic_load_n(&src->site_count,
+			__ATOMIC_ACQUIRE);
+	for (i = 0; i < stats->site_count; i++) {
+		const struct gralloc_drm_lock_site *s = &src->sites[i];
+		struct gralloc_drm_lock_site *dst = &stats->sites[i];
+
+		mutex_copy_site(dst->name, sizeof(dst->name),
+				__atomic_load_n(&m->site_keys[i],
+					__ATOMIC_RELAXED));
+		dst->locks = mutex_stat_read(&s->locks);
+		dst->contentions = mutex_stat_read(&s->contentions);
+		dst->wait_ns = mutex_stat_read(&s->wait_ns);
+		dst->hold_ns = mutex_stat_read(&s->hold_ns);
+	}
+}
+
+/*
+ * Snapshot the accounting of the mutexes, most contended first in total
+ * wait.  count is the size of stats on entry and the number of mutexes
+ * copied on return.  Only the list mutex is taken, so that the snapshot
+ * never waits for the mutexes it describes, however contended.
+ */
+int gralloc_drm_get_lock_stats(struct gralloc_drm_lock_stats *stats,
+		int *count)
+{
+	struct gralloc_drm_mutex *m;
+	int n = 0, i, j;
+
+	if (!__atomic_load_n(&gralloc_drm_mutex_profiling, __ATOMIC_ACQUIRE) ||
+	    *count < 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&mutex_list_mutex);
+	for (m = mutex_list; m && n < *count; m = m->next) {
+		struct gralloc_drm_lock_stats tmp;
+
+		mutex_snapshot(m, &tmp);
+
+		/* insertion sort, as there are a handful of mutexes */
+		for (i = n; i > 0 && stats[i - 1].wait_ns < tmp.wait_ns; i--)
+			;
+		for (j = n; j > i; j--)
+			stats[j] = stats[j - 1];
+		stats[i] = tmp;
+		n++;
+	}
+	pthread_mutex_unlock(&mutex_list_mutex);
+
+	*count = n;
+
+	return 0;
+}
+
+/*
+ * Describe the contention of the mutexes in buf, for dumpsys.  Return the
+ * length of the text, which is truncated to len - 1 bytes.
+ */
+int gralloc_drm_dump_lock_stats(char *buf, int len)
+{
+	struct gralloc_drm_lock_stats stats[8];
+	struct gralloc_drm_dump_buf lb = { buf, len, 0 };
+	int count = 8, i, j;
+
+	if (len <= 0)
+		return -EINVAL;
+	buf[0] = '\0';
+
+	if (gralloc_drm_get_lock_stats(stats, &count))
+		return 0;
+
+	gralloc_drm_dump_printf(&lb, "mutex contention:\n");
+	for (i = 0; i < count; i++) {
+		const struct gralloc_drm_lock_stats *s = &stats[i];
+
+		gralloc_drm_dump_printf(&lb,
+				"  %s: %lld/%lld locks waited %lld us "
+				"(max %lld us, tid %d in %s behind tid %d in %s), "
+				"held %lld us (max %lld us in %s)\n",
+				s->name, (long long) s->contentions,
+				(long long) s->locks,
+				(long long) (s->wait_ns / 1000),
+				(long long) (s->max_wait_ns / 1000),
+				s->max_wait_tid, s->max_wait_site,
+				s->max_wait_owner_tid, s->max_wait_owner_site,
+				(long long) (s->hold_ns / 1000),
+				(long long) (s->max_hold_ns / 1000),
+				s->max_hold_site);
+
+		for (j = 0; j < s->site_count; j++) {
+			gralloc_drm_dump_printf(&lb,
+					"    %s: %lld/%lld locks waited "
+					"%lld us, held %lld us\n",
+					s->sites[j].name,
+					(long long) s->sites[j].contentions,
+					(long long) s->sites[j].locks,
+					(long long) (s->sites[j].wait_ns / 1000),
+					(long long) (s->sites[j].hold_ns / 1000));
+		}
+	}
+
+	return gralloc_drm_dump_length(&lb);
+}
@@ -64,6 +64,25 @@ struct nouveau_buffer {
 	struct nouveau_bo *bo;
 };
 
+static int is_tiled(struct nouveau_info *info, int usage)
+{
+	int tiled, scanout;
+
+	scanout = !!(usage & GRALLOC_USAGE_HW_FB);
+
+	tiled = !(usage & (GRALLOC_USAGE_SW_READ_OFTEN |
+			   GRALLOC_USAGE_SW_WRITE_OFTEN));
+	if (!info->chan)
+		tiled = 0;
+	else if (scanout && info->tiled_scanout)
+		tiled = 1;
+
+	if (info->arch >= 0x50 && !(scanout && !info->tiled_scanout))
+		tiled = 1;
+
+	return tiled;
+}
+
 static struct nouveau_bo *alloc_bo(struct nouveau_info *info,
 		int width, int height, int cpp, int usage, int *pitch)
 {
@@ -71,28 +90,19 @@ static struct nouveau_bo *alloc_bo(struct nouveau_info *info,
 	int flags, tile_mode, tile_flags;
 	int tiled, scanout;
 	unsigned int align;
+	size_t size;
 
 	flags = NOUVEAU_BO_MAP | NOUVEAU_BO_VRAM;
 	tile_mode = 0;
 	tile_flags = 0;
 
 	scanout = !!(usage & GRALLOC_USAGE_HW_FB);
-
-	tiled = !(usage & (GRALLOC_USAGE_SW_READ_OFTEN |
-			   GRALLOC_USAGE_SW_WRITE_OFTEN));
-	if (!info->chan)
-		tiled = 0;
-	else if (scanout && info->tiled_scanout)
-		tiled = 1;
+	tiled = is_tiled(info, usage);
 
 	/* calculate pitch align */
 	align = 64;
-	if (info->arch >= 0x50) {
-		if (scanout && !info->tiled_scanout)
-			align = 256;
-		else
-			tiled = 1;
-	}
+	if (info->arch >= 0x50 && scanout && !info->tiled_scanout)
+		align = 256;
 
 	*pitch = ALIGN(width * cpp, align);
 
@@ -161,10 +171,16 @@ static struct nouveau_bo *alloc_bo(struct nouveau_info *info,
 	if (scanout)
 		tile_flags |= NOUVEAU_BO_TILE_SCANOUT;
 
-	if (nouveau_bo_new_tile(info->dev, flags, 0, *pitch * height,
+	size = (size_t) *pitch * height;
+
+	/* round linear bos up so that they can be re-described */
+	if (!tiled)
+		size = gralloc_drm_size_class(size);
+
+	if (nouveau_bo_new_tile(info->dev, flags, 0, size,
 				tile_mode, tile_flags, &bo)) {
-		ALOGE("failed to allocate bo (flags 0x%x, size %d, tile_mode 0x%x, tile_flags 0x%x)",
-				flags, *pitch * height, tile_mode, tile_flags);
+		ALOGE("failed to allocate bo (flags 0x%x, size %zu, tile_mode 0x%x, tile_flags 0x%x)",
+				flags, size, tile_mode, tile_flags);
 		bo = NULL;
 	}
 
@@ -226,11 +242,41 @@ nouveau_alloc(struct gralloc_drm_drv_t *drv, struct gralloc_drm_handle_t *handle
 	if (handle->usage & GRALLOC_USAGE_HW_FB)
 		nb->base.fb_handle = nb->bo->handle;
 
+	nb->base.size = nb->bo->size;
 	nb->base.handle = handle;
 
 	return &nb->base;
 }
 
+static int nouveau_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct nouveau_info *info = (struct nouveau_info *) drv;
+	int width, height, cpp, pitch;
+
+	/* the tile mode of tiled bos depends on the height */
+	if (is_tiled(info, handle->usage))
+		return -EINVAL;
+
+	cpp = gralloc_drm_get_bpp(handle->format);
+	if (!cpp)
+		return -EINVAL;
+
+	width = handle->width;
+	height = handle->height;
+	gralloc_drm_align_geometry(handle->format, &width, &height);
+
+	pitch = ALIGN(width * cpp, 64);
+	if (!gralloc_drm_size_class_match((size_t) pitch * height, bo->size))
+		return -EINVAL;
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
+}
+
 static void nouveau_free(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_bo_t *bo)
 {
@@ -357,6 +403,7 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_nouveau(int fd)
 	info->base.free = nouveau_free;
 	info->base.map = nouveau_map;
 	info->base.unmap = nouveau_unmap;
+	info->base.redescribe = nouveau_redescribe;
 
 	return &info->base;
 }
@@ -31,20 +31,35 @@
 #include <frontend/drm_driver.h>
 #include <util/u_inlines.h>
 #include <util/u_memory.h>
+#include <util/format/u_format.h>
 
+#include <xf86drm.h>
+#include <xf86drmMode.h>
 #include <drm_fourcc.h>
 #include "gralloc_drm.h"
 #include "gralloc_drm_priv.h"
 
+/* a layout that a KMS plane scans out */
+struct pipe_kms_modifier {
+	uint32_t fourcc;
+	uint64_t modifier;
+};
+
+#define PIPE_MAX_MODIFIERS 32
+
 struct pipe_manager {
 	struct gralloc_drm_drv_t base;
 
 	int fd;
 	int kms_fd;
 	char driver[16];
-	pthread_mutex_t mutex;
+	struct gralloc_drm_mutex mutex;
 	struct pipe_screen *screen;
 	struct pipe_context *context;
+
+	/* from the IN_FORMATS of the planes, see pipe_init_kms_modifiers */
+	struct pipe_kms_modifier *kms_modifiers;
+	int kms_modifier_count;
 };
 
 struct pipe_buffer {
@@ -58,33 +73,45 @@ struct pipe_buffer {
 
 static enum pipe_format get_pipe_format(int format)
 {
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
 	enum pipe_format fmt;
 
-	switch (format) {
-	case HAL_PIXEL_FORMAT_RGBA_8888:
+	if (!desc)
+		return PIPE_FORMAT_NONE;
+
+	/*
+	 * planar; the planes are rows of luma-sized samples, see
+	 * get_pipe_buffer_locked
+	 */
+	if (desc->num_planes > 1)
+		return (desc->bpp[0] == 2) ?
+			PIPE_FORMAT_R16_UNORM : PIPE_FORMAT_R8_UNORM;
+
+	switch (desc->fourcc) {
+	case DRM_FORMAT_ABGR8888:
 		fmt = PIPE_FORMAT_R8G8B8A8_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_RGBX_8888:
+	case DRM_FORMAT_XBGR8888:
 		fmt = PIPE_FORMAT_R8G8B8X8_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_RGB_888:
+	case DRM_FORMAT_BGR888:
 		fmt = PIPE_FORMAT_R8G8B8_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_RGB_565:
+	case DRM_FORMAT_RGB565:
 		fmt = PIPE_FORMAT_B5G6R5_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_BGRA_8888:
+	case DRM_FORMAT_ARGB8888:
 		fmt = PIPE_FORMAT_B8G8R8A8_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_BLOB:
-		fmt = PIPE_FORMAT_R8_UNORM;
+	case DRM_FORMAT_ABGR16161616F:
+		fmt = PIPE_FORMAT_R16G16B16A16_FLOAT;
 		break;
-	case HAL_PIXEL_FORMAT_YV12:
-	case HAL_PIXEL_FORMAT_YCBCR_420_888:
-		fmt = PIPE_FORMAT_R8G8_UNORM;
+	case DRM_FORMAT_ABGR2101010:
+		fmt = PIPE_FORMAT_R10G10B10A2_UNORM;
+		break;
+	case DRM_FORMAT_R8:
+		fmt = PIPE_FORMAT_R8_UNORM;
 		break;
-	case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-	case HAL_PIXEL_FORMAT_YCrCb_420_SP:
 	default:
 		fmt = PIPE_FORMAT_NONE;
 		break;
@@ -109,11 +136,188 @@ static unsigned get_pipe_bind(int usage)
 	return bind;
 }
 
+/*
+ * Add the layouts of an IN_FORMATS blob to the table of the layouts that
+ * some plane scans out.
+ */
+static void pipe_add_kms_modifiers(struct pipe_manager *pm,
+		const drmModePropertyBlobRes *blob, int *size)
+{
+	const struct drm_format_modifier_blob *header =
+		(const struct drm_format_modifier_blob *) blob->data;
+	const uint32_t *formats;
+	const struct drm_format_modifier *mods;
+	uint32_t i, j;
+	int k;
+
+	if (blob->length < sizeof(*header) ||
+	    header->formats_offset + header->count_formats *
+		sizeof(*formats) > blob->length ||
+	    header->modifiers_offset + header->count_modifiers *
+		sizeof(*mods) > blob->length)
+		return;
+
+	formats = (const uint32_t *)
+		((const char *) header + header->formats_offset);
+	mods = (const struct drm_format_modifier *)
+		((const char *) header + header->modifiers_offset);
+
+	for (i = 0; i < header->count_modifiers; i++) {
+		for (j = 0; j < 64; j++) {
+			struct pipe_kms_modifier entry;
+
+			if (!(mods[i].formats & (1ULL << j)) ||
+			    mods[i].offset + j >= header->count_formats)
+				continue;
+
+			entry.fourcc = formats[mods[i].offset + j];
+			entry.modifier = mods[i].modifier;
+
+			for (k = 0; k < pm->kms_modifier_count; k++) {
+				if (pm->kms_modifiers[k].fourcc == entry.fourcc &&
+				    pm->kms_modifiers[k].modifier == entry.modifier)
+					break;
+			}
+			if (k < pm->kms_modifier_count)
+				continue;
+
+			if (pm->kms_modifier_count >= *size) {
+				struct pipe_kms_modifier *tmp;
+				int new_size = (*size) ? *size * 2 : 64;
+
+				tmp = REALLOC(pm->kms_modifiers,
+						sizeof(*tmp) * *size,
+						sizeof(*tmp) * new_size);
+				if (!tmp)
+					return;
+
+				pm->kms_modifiers = tmp;
+				*size = new_size;
+			}
+
+			pm->kms_modifiers[pm->kms_modifier_count++] = entry;
+		}
+	}
+}
+
+/*
+ * Collect the layouts that the KMS planes scan out, from their IN_FORMATS
+ * properties.  Without them, as on render nodes or old kernels, scanout
+ * buffers stay linear.
+ */
+static void pipe_init_kms_modifiers(struct pipe_manager *pm)
+{
+	int fd = (pm->kms_fd > 0) ? pm->kms_fd : pm->fd;
+	drmModePlaneResPtr planes;
+	uint32_t i, j;
+	int size = 0;
+
+	/* list the primary and cursor planes as well */
+	drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+	planes = drmModeGetPlaneResources(fd);
+	if (!planes)
+		return;
+
+	for (i = 0; i < planes->count_planes; i++) {
+		drmModeObjectPropertiesPtr props;
+
+		props = drmModeObjectGetProperties(fd, planes->planes[i],
+				DRM_MODE_OBJECT_PLANE);
+		if (!props)
+			continue;
+
+		for (j = 0; j < props->count_props; j++) {
+			drmModePropertyPtr prop;
+			drmModePropertyBlobPtr blob;
+
+			prop = drmModeGetProperty(fd, props->props[j]);
+			if (!prop)
+				continue;
+
+			if (strcmp(prop->name, "IN_FORMATS") == 0) {
+				blob = drmModeGetPropertyBlob(fd,
+						props->prop_values[j]);
+				if (blob) {
+					pipe_add_kms_modifiers(pm, blob, &size);
+					drmModeFreePropertyBlob(blob);
+				}
+			}
+
+			drmModeFreeProperty(prop);
+		}
+
+		drmModeFreeObjectProperties(props);
+	}
+
+	drmModeFreePlaneResources(planes);
+
+	ALOGI("KMS planes scan out %d format layouts", pm->kms_modifier_count);
+}
+
+static int pipe_kms_supports(struct pipe_manager *pm, uint32_t fourcc,
+		uint64_t modifier)
+{
+	int i;
+
+	for (i = 0; i < pm->kms_modifier_count; i++) {
+		if (pm->kms_modifiers[i].fourcc == fourcc &&
+		    pm->kms_modifiers[i].modifier == modifier)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Return the modifiers a new resource may have, best first as the screen
+ * lists them.  Buffers that the CPU accesses, and planar buffers whose
+ * chroma planes are extra rows, are linear.  Scanout buffers take only
+ * the modifiers that a KMS plane scans out.
+ */
+static int get_pipe_modifiers(struct pipe_manager *pm,
+		const struct gralloc_drm_handle_t *handle,
+		enum pipe_format format, uint64_t *modifiers)
+{
+	const struct gralloc_drm_format *desc =
+		gralloc_drm_get_format(handle->format);
+	unsigned int external_only[PIPE_MAX_MODIFIERS];
+	uint64_t mods[PIPE_MAX_MODIFIERS];
+	int sw = (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK);
+	int scanout = (handle->usage &
+			(GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_HW_COMPOSER));
+	int count = 0, n = 0, i;
+
+	if (desc && desc->num_planes == 1 && !(handle->usage & sw) &&
+	    pm->screen->query_dmabuf_modifiers) {
+		pm->screen->query_dmabuf_modifiers(pm->screen, format,
+				PIPE_MAX_MODIFIERS, mods, external_only,
+				&count);
+	}
+
+	for (i = 0; i < count; i++) {
+		/* those are for external textures only */
+		if (external_only[i])
+			continue;
+
+		if (scanout && !pipe_kms_supports(pm, desc->fourcc, mods[i]))
+			continue;
+
+		modifiers[n++] = mods[i];
+	}
+
+	if (!n)
+		modifiers[n++] = DRM_FORMAT_MOD_LINEAR;
+
+	return n;
+}
+
 static struct pipe_buffer *get_pipe_buffer_locked(struct pipe_manager *pm,
 		struct gralloc_drm_handle_t *handle)
 {
 	struct pipe_buffer *buf;
 	struct pipe_resource templ;
+	int width, height;
 
 	memset(&templ, 0, sizeof(templ));
 	templ.format = get_pipe_format(handle->format);
@@ -133,8 +337,13 @@ static struct pipe_buffer *get_pipe_buffer_locked(struct pipe_manager *pm,
 		return NULL;
 	}
 
-	templ.width0 = handle->width;
-	templ.height0 = handle->height;
+	/* the chroma planes of planar formats are extra rows */
+	width = handle->width;
+	height = handle->height;
+	gralloc_drm_align_geometry(handle->format, &width, &height);
+
+	templ.width0 = width;
+	templ.height0 = height;
 	templ.depth0 = 1;
 	templ.array_size = 1;
 
@@ -142,24 +351,41 @@ static struct pipe_buffer *get_pipe_buffer_locked(struct pipe_manager *pm,
 		buf->winsys.type = WINSYS_HANDLE_TYPE_FD;
 		buf->winsys.handle = handle->prime_fd;
 		buf->winsys.stride = handle->stride;
-		buf->winsys.modifier = DRM_FORMAT_MOD_LINEAR;
+		/*
+		 * heap, dumb and older handles leave the modifier implicit,
+		 * which some drivers read as tiled; they are all linear
+		 */
+		buf->winsys.modifier =
+			(handle->modifier == DRM_FORMAT_MOD_INVALID) ?
+			DRM_FORMAT_MOD_LINEAR : handle->modifier;
 		buf->resource = pm->screen->resource_from_handle(pm->screen,
 				&templ, &buf->winsys, 0);
 		if (!buf->resource)
 			goto fail;
 	}
 	else {
-		const uint64_t mod = DRM_FORMAT_MOD_LINEAR;
+		uint64_t mods[PIPE_MAX_MODIFIERS];
+		int count;
+
+		/* the screen picks the best layout of those */
+		count = get_pipe_modifiers(pm, handle, templ.format, mods);
 		buf->resource =
-			pm->screen->resource_create_with_modifiers(pm->screen, &templ, &mod, 1);
+			pm->screen->resource_create_with_modifiers(pm->screen,
+					&templ, mods, count);
 		if (!buf->resource)
 			goto fail;
 
 		buf->winsys.type = WINSYS_HANDLE_TYPE_FD;
+		buf->winsys.modifier = DRM_FORMAT_MOD_INVALID;
 		if (!pm->screen->resource_get_handle(pm->screen, 0,
 					buf->resource, &buf->winsys, 0))
 			goto fail;
 		handle->prime_fd = (int) buf->winsys.handle;
+
+		/* a single choice needs no report */
+		if (buf->winsys.modifier == DRM_FORMAT_MOD_INVALID && count == 1)
+			buf->winsys.modifier = mods[0];
+		handle->modifier = buf->winsys.modifier;
 	}
 
 	/* need the gem handle */
@@ -192,14 +418,16 @@ static struct gralloc_drm_bo_t *pipe_alloc(struct gralloc_drm_drv_t *drv,
 	struct pipe_manager *pm = (struct pipe_manager *) drv;
 	struct pipe_buffer *buf;
 
-	pthread_mutex_lock(&pm->mutex);
+	gralloc_drm_mutex_lock(&pm->mutex);
 	buf = get_pipe_buffer_locked(pm, handle);
-	pthread_mutex_unlock(&pm->mutex);
+	gralloc_drm_mutex_unlock(&pm->mutex);
 
 	if (buf) {
 		handle->name = (int) buf->winsys.handle;
 		handle->stride = (int) buf->winsys.stride;
 
+		buf->base.size = (size_t) handle->stride *
+			buf->resource->height0;
 		buf->base.handle = handle;
 	}
 
@@ -211,7 +439,7 @@ static void pipe_free(struct gralloc_drm_drv_t *drv, struct gralloc_drm_bo_t *bo
 	struct pipe_manager *pm = (struct pipe_manager *) drv;
 	struct pipe_buffer *buf = (struct pipe_buffer *) bo;
 
-	pthread_mutex_lock(&pm->mutex);
+	gralloc_drm_mutex_lock(&pm->mutex);
 
 	if (bo->handle->prime_fd >= 0) {
 		close(bo->handle->prime_fd);
@@ -222,11 +450,29 @@ static void pipe_free(struct gralloc_drm_drv_t *drv, struct gralloc_drm_bo_t *bo
 		pipe_transfer_unmap(pm->context, buf->transfer);
 	pipe_resource_reference(&buf->resource, NULL);
 
-	pthread_mutex_unlock(&pm->mutex);
+	gralloc_drm_mutex_unlock(&pm->mutex);
 
 	FREE(buf);
 }
 
+/*
+ * Create the context, which transfers need, on first use.  The mutex must
+ * be held.
+ */
+static int pipe_get_context_locked(struct pipe_manager *pm)
+{
+	if (pm->context)
+		return 0;
+
+	pm->context = pm->screen->context_create(pm->screen, NULL, 0);
+	if (!pm->context) {
+		ALOGE("failed to create pipe context");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
 static int pipe_map(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
 		int enable_write, void **addr)
@@ -235,19 +481,12 @@ static int pipe_map(struct gralloc_drm_drv_t *drv,
 	struct pipe_buffer *buf = (struct pipe_buffer *) bo;
 	int err = 0;
 
-	pthread_mutex_lock(&pm->mutex);
-
-	/* need a context to get transfer */
-	if (!pm->context) {
-		pm->context = pm->screen->context_create(pm->screen, NULL, 0);
-		if (!pm->context) {
-			ALOGE("failed to create pipe context");
-			err = -ENOMEM;
-		}
-	}
+	gralloc_drm_mutex_lock(&pm->mutex);
 
+	err = pipe_get_context_locked(pm);
 	if (!err) {
 		enum pipe_transfer_usage usage;
+		uint8_t *ptr;
 
 		usage = PIPE_TRANSFER_READ;
 		if (enable_write)
@@ -255,19 +494,39 @@ static int pipe_map(struct gralloc_drm_drv_t *drv,
 
 		assert(!buf->transfer);
 
+		ptr = pipe_transfer_map(pm->context, buf->resource,
+					0, 0, usage, x, y, w, h,
+					&buf->transfer);
+
 		/*
-		 * ignore x, y, w and h so that returned addr points at the
-		 * start of the buffer
+		 * addr must point at the start of the buffer; a staged
+		 * transfer has its own stride, so map all of it instead.
+		 * Tiled bos never get here, see gralloc_drm_bo_lock.
 		 */
-		*addr = pipe_transfer_map(pm->context, buf->resource,
-					  0, 0, usage, 0, 0,
-					  buf->resource->width0, buf->resource->height0,
-					  &buf->transfer);
-		if (*addr == NULL)
+		if (ptr && buf->transfer->stride != (unsigned) bo->handle->stride &&
+		    (x || y || w != (int) buf->resource->width0 ||
+		     h != (int) buf->resource->height0)) {
+			pipe_transfer_unmap(pm->context, buf->transfer);
+			x = 0;
+			y = 0;
+			ptr = pipe_transfer_map(pm->context, buf->resource,
+						0, 0, usage, 0, 0,
+						buf->resource->width0,
+						buf->resource->height0,
+						&buf->transfer);
+		}
+
+		if (ptr) {
+			*addr = ptr - y * buf->transfer->stride -
+				x * util_format_get_blocksize(buf->resource->format);
+		}
+		else {
+			buf->transfer = NULL;
 			err = -ENOMEM;
+		}
 	}
 
-	pthread_mutex_unlock(&pm->mutex);
+	gralloc_drm_mutex_unlock(&pm->mutex);
 
 	return err;
 }
@@ -278,16 +537,88 @@ static void pipe_unmap(struct gralloc_drm_drv_t *drv,
 	struct pipe_manager *pm = (struct pipe_manager *) drv;
 	struct pipe_buffer *buf = (struct pipe_buffer *) bo;
 
-	pthread_mutex_lock(&pm->mutex);
+	gralloc_drm_mutex_lock(&pm->mutex);
 
 	assert(buf && buf->transfer);
 
 	pipe_transfer_unmap(pm->context, buf->transfer);
 	buf->transfer = NULL;
 
+	gralloc_drm_timeline_begin("pipe_flush");
 	pm->context->flush(pm->context, NULL, 0);
+	gralloc_drm_timeline_end("pipe_flush");
+
+	gralloc_drm_mutex_unlock(&pm->mutex);
+}
+
+static void pipe_unmap_async(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int *fence_fd)
+{
+	struct pipe_manager *pm = (struct pipe_manager *) drv;
+	struct pipe_buffer *buf = (struct pipe_buffer *) bo;
+	struct pipe_fence_handle *fence = NULL;
+
+	gralloc_drm_mutex_lock(&pm->mutex);
+
+	assert(buf && buf->transfer);
+
+	pipe_transfer_unmap(pm->context, buf->transfer);
+	buf->transfer = NULL;
+
+	/* let the consumer wait for the upload instead of us */
+	gralloc_drm_timeline_begin("pipe_flush");
+	pm->context->flush(pm->context, &fence,
+			PIPE_FLUSH_ASYNC | PIPE_FLUSH_FENCE_FD);
+	gralloc_drm_timeline_end("pipe_flush");
+
+	*fence_fd = -1;
+	if (fence) {
+		if (pm->screen->fence_get_fd)
+			*fence_fd = pm->screen->fence_get_fd(pm->screen, fence);
+		pm->screen->fence_reference(pm->screen, &fence, NULL);
+	}
+
+	gralloc_drm_mutex_unlock(&pm->mutex);
+}
+
+/*
+ * Zero a resource through a transfer of all of it.  A transfer covers the
+ * rows at its own stride, which differs from the stride of the handle
+ * when the resource is staged or tiled.
+ */
+static int pipe_clear(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct pipe_manager *pm = (struct pipe_manager *) drv;
+	struct pipe_buffer *buf = (struct pipe_buffer *) bo;
+	struct pipe_transfer *transfer;
+	uint8_t *ptr;
+	int err;
+
+	gralloc_drm_mutex_lock(&pm->mutex);
+
+	err = pipe_get_context_locked(pm);
+	if (!err) {
+		ptr = pipe_transfer_map(pm->context, buf->resource,
+					0, 0, PIPE_TRANSFER_WRITE, 0, 0,
+					buf->resource->width0,
+					buf->resource->height0, &transfer);
+		if (ptr) {
+			memset(ptr, 0, (size_t) transfer->stride *
+					util_format_get_nblocksy(
+						buf->resource->format,
+						buf->resource->height0));
+			pipe_transfer_unmap(pm->context, transfer);
+			pm->context->flush(pm->context, NULL, 0);
+		}
+		else {
+			err = -ENOMEM;
+		}
+	}
+
+	gralloc_drm_mutex_unlock(&pm->mutex);
 
-	pthread_mutex_unlock(&pm->mutex);
+	return err;
 }
 
 static void pipe_destroy(struct gralloc_drm_drv_t *drv)
@@ -297,6 +628,8 @@ static void pipe_destroy(struct gralloc_drm_drv_t *drv)
 	if (pm->context)
 		pm->context->destroy(pm->context);
 	pm->screen->destroy(pm->screen);
+	gralloc_drm_mutex_destroy(&pm->mutex);
+	FREE(pm->kms_modifiers);
 	FREE(pm);
 }
 
@@ -527,7 +860,7 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_pipe(int fd, int kms_fd, co
 
 	pm->fd = fd;
 	pm->kms_fd = kms_fd;
-	pthread_mutex_init(&pm->mutex, NULL);
+	gralloc_drm_mutex_init(&pm->mutex, "pipe");
 
 	if (pipe_find_driver(pm, name)) {
 		FREE(pm);
@@ -539,11 +872,21 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_pipe(int fd, int kms_fd, co
 		return NULL;
 	}
 
+	pipe_init_kms_modifiers(pm);
+
 	pm->base.destroy = pipe_destroy;
 	pm->base.alloc = pipe_alloc;
 	pm->base.free = pipe_free;
 	pm->base.map = pipe_map;
 	pm->base.unmap = pipe_unmap;
+	pm->base.unmap_async = pipe_unmap_async;
+	pm->base.clear = pipe_clear;
+	/*
+	 * resources of linear modifiers are mapped through their fds where
+	 * the kernel driver implements mmap of its dma-bufs
+	 */
+	pm->base.prime_mappable = (strcmp(pm->driver, "vc4") == 0 ||
+				   strcmp(pm->driver, "v3d") == 0);
 
 	return &pm->base;
 }
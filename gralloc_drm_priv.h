@@ -25,6 +25,8 @@
 #define _GRALLOC_DRM_PRIV_H_
 
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
@@ -34,17 +36,80 @@
 extern "C" {
 #endif
 
+/*
+ * A mutex whose contention is accounted when gralloc.drm.lock_profile is
+ * set, see gralloc_drm_mutex.c.  The accounting is updated atomically
+ * with the mutex held, and read without it.
+ */
+struct gralloc_drm_mutex {
+	pthread_mutex_t mutex;
+	const char *name;
+
+	/* the holder, when locked with the accounting */
+	int32_t owner;
+	const char *owner_site;
+	int64_t acquired; /* 0 when locked without the accounting */
+
+	int registered;
+	struct gralloc_drm_mutex *next;
+	const char *site_keys[GRALLOC_DRM_LOCK_SITES];
+	struct gralloc_drm_lock_stats stats; /* without the site names */
+	const char *max_wait_site;
+	const char *max_wait_owner_site;
+	const char *max_hold_site;
+};
+
+#define GRALLOC_DRM_MUTEX_INITIALIZER(name) \
+	{ PTHREAD_MUTEX_INITIALIZER, name, 0, NULL, 0, 0, NULL, { NULL }, \
+	  { { 0 } }, NULL, NULL, NULL }
+
 struct gralloc_drm_t {
 	/* initialized by gralloc_drm_create */
 	int fd;
 	int kms_fd;
 	struct gralloc_drm_drv_t *drv;
+	struct gralloc_drm_drv_t *heap; /* for bos the GPU does not use */
+	int heap_alloc; /* false if drm->heap only imports */
+
+	/* serializes imports in validate_handle */
+	struct gralloc_drm_mutex import_mutex;
+
+	/* freed bos kept for reuse, most recently freed first */
+	struct gralloc_drm_mutex cache_mutex;
+	struct gralloc_drm_bo_t *cache_head, *cache_tail;
+	size_t cache_bytes;
+	size_t cache_max_bytes;
+	int64_t cache_max_age; /* in ns */
+
+	/* zero-fills cached bos in the background, see gralloc_drm_clear_worker */
+	pthread_t clear_thread;
+	pthread_cond_t clear_cond;
+	int clear_running;
+	int clear_quit;
+
+	/* bos whose mapping is kept across locks, oldest first */
+	struct gralloc_drm_mutex map_mutex;
+	struct gralloc_drm_bo_t *map_head, *map_tail;
+	size_t map_bytes;
+	size_t map_max_bytes;
+
+	/* map GRALLOC_USAGE_SW_READ_OFTEN bos cached through their prime fds */
+	int dmabuf_map;
+
+	/* updated atomically, see gralloc_drm_stats.c */
+	struct gralloc_drm_stats stats;
+
+	/* NULL unless gralloc.drm.stall_profile is set */
+	struct gralloc_drm_stall_table *stalls;
+
+	/* NULL unless gralloc.drm.leak_track is set */
+	struct gralloc_drm_leak_table *leaks;
 };
 
 struct drm_module_t {
 	gralloc_module_t base;
 
-	pthread_mutex_t mutex;
+	struct gralloc_drm_mutex mutex;
 	struct gralloc_drm_t *drm;
 };
 
@@ -60,7 +125,11 @@ struct gralloc_drm_drv_t {
 	void (*free)(struct gralloc_drm_drv_t *drv,
 		     struct gralloc_drm_bo_t *bo);
 
-	/* map a bo for CPU access */
+	/*
+	 * map a bo for CPU access; at least the given rectangle must be
+	 * mapped, but the returned address is always that of the first
+	 * pixel of the bo
+	 */
 	int (*map)(struct gralloc_drm_drv_t *drv,
 		   struct gralloc_drm_bo_t *bo,
 		   int x, int y, int w, int h, int enable_write, void **addr);
@@ -69,24 +138,158 @@ struct gralloc_drm_drv_t {
 	void (*unmap)(struct gralloc_drm_drv_t *drv,
 		      struct gralloc_drm_bo_t *bo);
 
+	/*
+	 * unmap a bo without waiting for CPU writes to be flushed, optional;
+	 * return a sync_file fd signaled when they are, or -1
+	 */
+	void (*unmap_async)(struct gralloc_drm_drv_t *drv,
+			    struct gralloc_drm_bo_t *bo, int *fence_fd);
+
+	/*
+	 * wait for the bo before CPU access through a mapping kept from an
+	 * earlier map, optional; drivers that implement it have the mappings
+	 * of GRALLOC_USAGE_SW_*_OFTEN bos kept across locks and must map
+	 * whole bos
+	 */
+	int (*begin_cpu_access)(struct gralloc_drm_drv_t *drv,
+				struct gralloc_drm_bo_t *bo,
+				int x, int y, int w, int h, int enable_write);
+
+	/* finish CPU access through a kept mapping, optional */
+	void (*end_cpu_access)(struct gralloc_drm_drv_t *drv,
+			       struct gralloc_drm_bo_t *bo);
+
+	/*
+	 * return -EBUSY if CPU access to a bo would wait for the GPU, or,
+	 * with wait, block until it would not, optional; bos with prime fds
+	 * are polled otherwise
+	 */
+	int (*busy)(struct gralloc_drm_drv_t *drv,
+		    struct gralloc_drm_bo_t *bo, int write, int wait);
+
 	/* query component offsets, strides and handles for a format */
 	void (*resolve_format)(struct gralloc_drm_drv_t *drv,
 		     struct gralloc_drm_bo_t *bo,
 		     uint32_t *pitches, uint32_t *offsets, uint32_t *handles);
+
+	/*
+	 * zero the backing store of a bo, optional; drivers whose map()
+	 * covers less than the whole bo implement it
+	 */
+	int (*clear)(struct gralloc_drm_drv_t *drv,
+		     struct gralloc_drm_bo_t *bo);
+
+	/*
+	 * describe an unused bo with the geometry of a new handle, optional;
+	 * return 0 and update the stride of the handle if the backing store
+	 * is in the same size class
+	 */
+	int (*redescribe)(struct gralloc_drm_drv_t *drv,
+			  struct gralloc_drm_bo_t *bo,
+			  struct gralloc_drm_handle_t *handle);
+
+	/*
+	 * true if bos of implicit or linear modifiers are linear from the
+	 * start of their prime fds, so that they can be mapped through them
+	 */
+	int prime_mappable;
+
+	/*
+	 * true if map() returns bos of other modifiers detiled, at the
+	 * stride of their handles
+	 */
+	int tiled_mappable;
 };
 
+#define GRALLOC_DRM_LOCK_WRITABLE   (1 << 30)
+#define GRALLOC_DRM_LOCK_MAPPED     (1 << 29)
+#define GRALLOC_DRM_LOCK_COUNT_MASK (GRALLOC_DRM_LOCK_MAPPED - 1)
+
 struct gralloc_drm_bo_t {
 	struct gralloc_drm_t *drm;
+	struct gralloc_drm_drv_t *drv; /* drm->drv or drm->heap */
 	struct gralloc_drm_handle_t *handle;
 
 	int imported;  /* the handle is from a remote proces when true */
+	int exported;  /* the handle was handed to a client when true */
+	long export_count; /* dma-buf references when exported, or -1 */
 	int fb_handle; /* the GEM handle of the bo */
 	int fb_id;     /* the fb id */
 
-	int lock_count;
-	int locked_for;
+	/* CPU access, see gralloc_drm_bo_lock */
+	volatile int32_t lock_state; /* atomic */
+	pthread_mutex_t lock_mutex;
+	void *map_addr;
+	int map_x, map_y, map_w, map_h; /* the rectangle mapped */
+
+	/* the mapping is kept across locks, see gralloc_drm_bo_map_locked */
+	int map_kept;
+	struct gralloc_drm_bo_t *map_prev, *map_next;
+
+	/* mapped through the prime fd, and DMA_BUF_SYNC_* of the CPU access */
+	int dmabuf_mapped;
+	uint64_t dmabuf_sync;
+
+	volatile int32_t refcount; /* atomic */
+
+	size_t size;   /* size of the backing store, 0 if unknown */
+
+	/*
+	 * the backing store may hold stale data; drivers set it for new bos
+	 * unless the kernel hands out zeroed memory
+	 */
+	int needs_clear;
+
+	/* bo cache linkage, valid while the bo is in the cache */
+	struct gralloc_drm_bo_t *cache_prev, *cache_next;
+	int64_t cache_time;
+
+	/* the record of a live bo, see gralloc_drm_leak.c */
+	struct gralloc_drm_leak_entry *leak;
+};
+
+/*
+ * Return the monotonic time in nanoseconds.
+ */
+static inline int64_t gralloc_drm_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Round the size of a backing store up to its size class: 64 KiB steps
+ * below 4 MiB and 1 MiB steps above.
+ */
+static inline size_t gralloc_drm_size_class(size_t size)
+{
+	if (size < 4 * 1024 * 1024)
+		return ALIGN(size, (size_t) 64 * 1024);
+	else
+		return ALIGN(size, (size_t) 1024 * 1024);
+}
+
+/*
+ * Return true if a backing store of bo_size bytes can hold size bytes and
+ * is in the same size class.
+ */
+static inline int gralloc_drm_size_class_match(size_t size, size_t bo_size)
+{
+	return (size <= bo_size &&
+		gralloc_drm_size_class(size) == gralloc_drm_size_class(bo_size));
+}
 
-	unsigned int refcount;
+/*
+ * A buffer of the caller that the dumps for dumpsys append text to, see
+ * gralloc_drm_dump_printf.
+ */
+struct gralloc_drm_dump_buf {
+	char *buf;
+	int len;
+	int pos;
 };
 
 struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_pipe(int fd, int kms_fd, const char *name);
@@ -94,6 +297,95 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_intel(int fd);
 struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_radeon(int fd);
 struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_rockchip(int fd);
 struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_nouveau(int fd);
+struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_dumb(int fd);
+struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_heap(int alloc);
+
+int gralloc_drm_dmabuf_sync(int fd, uint64_t flags);
+int64_t gralloc_drm_bo_get_size(const struct gralloc_drm_bo_t *bo);
+void gralloc_drm_bo_export(struct gralloc_drm_bo_t *bo);
+
+void gralloc_drm_dump_printf(struct gralloc_drm_dump_buf *db,
+		const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int gralloc_drm_dump_length(const struct gralloc_drm_dump_buf *db);
+
+void gralloc_drm_stats_alloc(struct gralloc_drm_t *drm,
+		struct gralloc_drm_drv_t *drv, struct gralloc_drm_bo_t *bo,
+		int64_t start, int cache_hit);
+void gralloc_drm_stats_free(struct gralloc_drm_bo_t *bo);
+void gralloc_drm_stats_import(struct gralloc_drm_t *drm, int err);
+void gralloc_drm_stats_lock(struct gralloc_drm_t *drm, int usage, int err);
+void gralloc_drm_stats_map(struct gralloc_drm_t *drm, int64_t start);
+
+void gralloc_drm_stall_init(struct gralloc_drm_t *drm);
+void gralloc_drm_stall_fini(struct gralloc_drm_t *drm);
+int64_t gralloc_drm_stall_wait(struct gralloc_drm_bo_t *bo, int write);
+void gralloc_drm_stall_record(struct gralloc_drm_bo_t *bo, int usage,
+		int64_t wait, int64_t start);
+
+void gralloc_drm_leak_init(struct gralloc_drm_t *drm);
+void gralloc_drm_leak_fini(struct gralloc_drm_t *drm);
+void gralloc_drm_leak_track(struct gralloc_drm_bo_t *bo, int pid);
+void gralloc_drm_leak_untrack(struct gralloc_drm_bo_t *bo);
+void gralloc_drm_leak_lock(struct gralloc_drm_bo_t *bo);
+
+extern int gralloc_drm_timeline_enabled;
+void gralloc_drm_timeline_init(void);
+void gralloc_drm_timeline_event(const char *name, int phase);
+int gralloc_drm_timeline_flush(const char *path);
+
+/*
+ * Mark the begin and the end of an operation on the timeline of the
+ * calling thread, see gralloc_drm_timeline.c.  name must be a string
+ * literal.
+ */
+static inline void gralloc_drm_timeline_begin(const char *name)
+{
+	if (__builtin_expect(__atomic_load_n(&gralloc_drm_timeline_enabled,
+					__ATOMIC_RELAXED), 0))
+		gralloc_drm_timeline_event(name, 'B');
+}
+
+static inline void gralloc_drm_timeline_end(const char *name)
+{
+	if (__builtin_expect(__atomic_load_n(&gralloc_drm_timeline_enabled,
+					__ATOMIC_RELAXED), 0))
+		gralloc_drm_timeline_event(name, 'E');
+}
+
+extern int gralloc_drm_mutex_profiling;
+void gralloc_drm_mutex_profile_init(void);
+void gralloc_drm_mutex_init(struct gralloc_drm_mutex *m, const char *name);
+void gralloc_drm_mutex_destroy(struct gralloc_drm_mutex *m);
+void gralloc_drm_mutex_lock_profiled(struct gralloc_drm_mutex *m,
+		const char *site);
+void gralloc_drm_mutex_unlock_profiled(struct gralloc_drm_mutex *m);
+void gralloc_drm_mutex_cond_wait_at(pthread_cond_t *cond,
+		struct gralloc_drm_mutex *m, const char *site);
+
+static inline void gralloc_drm_mutex_lock_at(struct gralloc_drm_mutex *m,
+		const char *site)
+{
+	if (__builtin_expect(__atomic_load_n(&gralloc_drm_mutex_profiling,
+					__ATOMIC_RELAXED), 0))
+		gralloc_drm_mutex_lock_profiled(m, site);
+	else
+		pthread_mutex_lock(&m->mutex);
+}
+
+static inline void gralloc_drm_mutex_unlock(struct gralloc_drm_mutex *m)
+{
+	if (__builtin_expect(m->acquired != 0, 0))
+		gralloc_drm_mutex_unlock_profiled(m);
+	else
+		pthread_mutex_unlock(&m->mutex);
+}
+
+/* the call site of a lock is the calling function */
+#define gralloc_drm_mutex_lock(m) gralloc_drm_mutex_lock_at((m), __func__)
+#define gralloc_drm_mutex_cond_wait(cond, m) \
+	gralloc_drm_mutex_cond_wait_at((cond), (m), __func__)
+
+struct gralloc_drm_t *gralloc_drm_create_for_drv(struct gralloc_drm_drv_t *drv);
 
 #ifdef __cplusplus
 }
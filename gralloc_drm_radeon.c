@@ -182,23 +182,21 @@ static uint32_t radeon_get_tiling(struct radeon_info *info,
 		return RADEON_TILING_MACRO;
 }
 
-static struct radeon_bo *radeon_alloc(struct radeon_info *info,
-		struct gralloc_drm_handle_t *handle)
+/* compute the tiling, pitch and size of a handle */
+static int radeon_get_layout(struct radeon_info *info,
+		const struct gralloc_drm_handle_t *handle,
+		uint32_t *tiling, int *pitch, int *size)
 {
-	struct radeon_bo *rbo;
 	int aligned_width, aligned_height;
-	int pitch, size, base_align;
-	uint32_t tiling, domain;
 	int cpp;
 
 	cpp = gralloc_drm_get_bpp(handle->format);
 	if (!cpp) {
 		ALOGE("unrecognized format 0x%x", handle->format);
-		return NULL;
+		return -EINVAL;
 	}
 
-	tiling = radeon_get_tiling(info, handle);
-	domain = RADEON_GEM_DOMAIN_VRAM;
+	*tiling = radeon_get_tiling(info, handle);
 
 	aligned_width = handle->width;
 	aligned_height = handle->height;
@@ -207,18 +205,44 @@ static struct radeon_bo *radeon_alloc(struct radeon_info *info,
 
 	if (handle->usage & (GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_HW_TEXTURE)) {
 		aligned_width = ALIGN(aligned_width,
-				radeon_get_pitch_align(info, cpp, tiling));
+				radeon_get_pitch_align(info, cpp, *tiling));
 		aligned_height = ALIGN(aligned_height,
-				radeon_get_height_align(info, tiling));
+				radeon_get_height_align(info, *tiling));
 	}
 
+	*pitch = aligned_width * cpp;
+	*size = ALIGN(aligned_height * *pitch, RADEON_GPU_PAGE_SIZE);
+
+	return 0;
+}
+
+/* return the domain of a new bo */
+static uint32_t radeon_get_domain(const struct gralloc_drm_handle_t *handle)
+{
 	if (!(handle->usage & (GRALLOC_USAGE_HW_FB |
 			       GRALLOC_USAGE_HW_RENDER)) &&
 	    (handle->usage & GRALLOC_USAGE_SW_READ_OFTEN))
-		domain = RADEON_GEM_DOMAIN_GTT;
+		return RADEON_GEM_DOMAIN_GTT;
+
+	return RADEON_GEM_DOMAIN_VRAM;
+}
+
+static struct radeon_bo *radeon_alloc(struct radeon_info *info,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct radeon_bo *rbo;
+	int pitch, size, base_align;
+	uint32_t tiling, domain;
+	int cpp;
+
+	if (radeon_get_layout(info, handle, &tiling, &pitch, &size))
+		return NULL;
+
+	cpp = gralloc_drm_get_bpp(handle->format);
+	domain = radeon_get_domain(handle);
 
-	pitch = aligned_width * cpp;
-	size = ALIGN(aligned_height * pitch, RADEON_GPU_PAGE_SIZE);
+	/* round up so that the bo can be re-described */
+	size = gralloc_drm_size_class(size);
 	base_align = radeon_get_base_align(info, cpp, tiling);
 
 	rbo = radeon_bo_open(info->bufmgr, 0, size, base_align, domain, 0);
@@ -243,14 +267,31 @@ static struct radeon_bo *radeon_alloc(struct radeon_info *info,
 	return rbo;
 }
 
-static void radeon_zero(struct radeon_info *info,
-		struct radeon_bo *rbo)
+static int drm_gem_radeon_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
 {
-	/* should use HW clear... */
-	if (!radeon_bo_map(rbo, 1)) {
-		memset(rbo->ptr, 0, rbo->size);
-		radeon_bo_unmap(rbo);
-	}
+	struct radeon_info *info = (struct radeon_info *) drv;
+	struct radeon_buffer *rbuf = (struct radeon_buffer *) bo;
+	uint32_t tiling;
+	int pitch, size;
+
+	if (radeon_get_layout(info, handle, &tiling, &pitch, &size) ||
+	    !gralloc_drm_size_class_match(size, bo->size))
+		return -EINVAL;
+
+	/* the base alignment of tiled bos depends on the bpp */
+	if (tiling && gralloc_drm_get_bpp(handle->format) !=
+			gralloc_drm_get_bpp(bo->handle->format))
+		return -EINVAL;
+
+	if (tiling)
+		radeon_bo_set_tiling(rbuf->rbo, tiling, pitch);
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
 }
 
 static struct gralloc_drm_bo_t *
@@ -280,13 +321,18 @@ drm_gem_radeon_alloc(struct gralloc_drm_drv_t *drv, struct gralloc_drm_handle_t
 			return NULL;
 		}
 
-		/* Android expects the buffer to be zeroed */
-		radeon_zero(info, rbuf->rbo);
+		/*
+		 * Android expects the buffer to be zeroed, but only GTT pages
+		 * are zeroed by the kernel
+		 */
+		rbuf->base.needs_clear =
+			(radeon_get_domain(handle) == RADEON_GEM_DOMAIN_VRAM);
 	}
 
 	if (handle->usage & GRALLOC_USAGE_HW_FB)
 		rbuf->base.fb_handle = rbuf->rbo->handle;
 
+	rbuf->base.size = rbuf->rbo->size;
 	rbuf->base.handle = handle;
 
 	return &rbuf->base;
@@ -320,6 +366,28 @@ static void drm_gem_radeon_unmap(struct gralloc_drm_drv_t *drv,
 	radeon_bo_unmap(rbuf->rbo);
 }
 
+static int drm_gem_radeon_busy(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int write, int wait)
+{
+	struct radeon_buffer *rbuf = (struct radeon_buffer *) bo;
+	uint32_t domain;
+
+	if (wait)
+		return radeon_bo_wait(rbuf->rbo);
+
+	return radeon_bo_is_busy(rbuf->rbo, &domain);
+}
+
+static int drm_gem_radeon_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write)
+{
+	struct radeon_buffer *rbuf = (struct radeon_buffer *) bo;
+
+	/* radeon_bo_map waits for the bo the same way */
+	return radeon_bo_wait(rbuf->rbo);
+}
+
 static void drm_gem_radeon_destroy(struct gralloc_drm_drv_t *drv)
 {
 	struct radeon_info *info = (struct radeon_info *) drv;
@@ -529,6 +597,9 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_radeon(int fd)
 	info->base.free = drm_gem_radeon_free;
 	info->base.map = drm_gem_radeon_map;
 	info->base.unmap = drm_gem_radeon_unmap;
+	info->base.begin_cpu_access = drm_gem_radeon_begin_cpu_access;
+	info->base.busy = drm_gem_radeon_busy;
+	info->base.redescribe = drm_gem_radeon_redescribe;
 
 	return &info->base;
 }
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The trace file written by gralloc.drm when gralloc.drm.record is set to
+ * a path.  Each process appends to <path>.<pid> a header followed by fixed
+ * size records, in the order the calls returned.  Little-endian, as the
+ * writer.
+ */
+
+#ifndef _GRALLOC_DRM_RECORD_H_
+#define _GRALLOC_DRM_RECORD_H_
+
+#include <stdint.h>
+
+#define GRALLOC_DRM_RECORD_MAGIC   0x54524447 /* "GDRT" */
+#define GRALLOC_DRM_RECORD_VERSION 1
+
+enum {
+	GRALLOC_DRM_RECORD_ALLOC = 1,
+	GRALLOC_DRM_RECORD_FREE,
+	GRALLOC_DRM_RECORD_REGISTER,
+	GRALLOC_DRM_RECORD_UNREGISTER,
+	GRALLOC_DRM_RECORD_LOCK,
+	GRALLOC_DRM_RECORD_LOCK_YCBCR,
+	GRALLOC_DRM_RECORD_UNLOCK,
+};
+
+struct gralloc_drm_record_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	int32_t pid;
+	int64_t start_time; /* CLOCK_MONOTONIC, in ns */
+};
+
+struct gralloc_drm_record {
+	int64_t time;      /* of the call, in ns since start_time */
+	uint64_t buffer;   /* identifies the buffer while it is alive */
+	uint32_t duration; /* in ns, saturated */
+	int32_t tid;
+	int32_t op;
+	int32_t err;
+
+	/* the buffer */
+	int32_t width;
+	int32_t height;
+	int32_t format;
+	int32_t usage;     /* of the lock for locks */
+
+	/* the rectangle of locks */
+	int32_t x;
+	int32_t y;
+	int32_t w;
+	int32_t h;
+};
+
+#endif /* _GRALLOC_DRM_RECORD_H_ */
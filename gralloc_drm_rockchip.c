@@ -33,26 +33,16 @@ static void drm_gem_rockchip_destroy(struct gralloc_drm_drv_t *drv)
 	free(info);
 }
 
-static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
-		struct gralloc_drm_drv_t *drv,
-		struct gralloc_drm_handle_t *handle)
+static int drm_gem_rockchip_get_size(
+		const struct gralloc_drm_handle_t *handle,
+		int *pitch, uint32_t *size)
 {
-	struct rockchip_info *info = (struct rockchip_info *)drv;
-	struct rockchip_buffer *buf;
-	struct drm_gem_close args;
-	int ret, cpp, pitch, aligned_width, aligned_height;
-	uint32_t size, gem_handle;
-
-	buf = calloc(1, sizeof(*buf));
-	if (!buf) {
-		ALOGE("Failed to allocate buffer wrapper\n");
-		return NULL;
-	}
+	int cpp, aligned_width, aligned_height;
 
 	cpp = gralloc_drm_get_bpp(handle->format);
 	if (!cpp) {
 		ALOGE("unrecognized format 0x%x", handle->format);
-		return NULL;
+		return -EINVAL;
 	}
 
 	aligned_width = handle->width;
@@ -61,8 +51,8 @@ static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
 			&aligned_width, &aligned_height);
 
 	/* TODO: We need to sort out alignment */
-	pitch = ALIGN(aligned_width * cpp, 64);
-	size = aligned_height * pitch;
+	*pitch = ALIGN(aligned_width * cpp, 64);
+	*size = aligned_height * *pitch;
 
 	if (handle->format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
 		/*
@@ -73,7 +63,31 @@ static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
 
 		w_mbs = ALIGN(handle->width, 16) / 16;
 		h_mbs = ALIGN(handle->height, 16) / 16;
-		size += 64 * w_mbs * h_mbs;
+		*size += 64 * w_mbs * h_mbs;
+	}
+
+	return 0;
+}
+
+static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
+		struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct rockchip_info *info = (struct rockchip_info *)drv;
+	struct rockchip_buffer *buf;
+	struct drm_gem_close args;
+	int ret, pitch;
+	uint32_t size, gem_handle;
+
+	buf = calloc(1, sizeof(*buf));
+	if (!buf) {
+		ALOGE("Failed to allocate buffer wrapper\n");
+		return NULL;
+	}
+
+	if (drm_gem_rockchip_get_size(handle, &pitch, &size)) {
+		free(buf);
+		return NULL;
 	}
 
 	if (handle->prime_fd >= 0) {
@@ -100,10 +114,13 @@ static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
 			return NULL;
 		}
 	} else {
+		/* round up so that the bo can be re-described */
+		size = gralloc_drm_size_class(size);
+
 		buf->bo = rockchip_bo_create(info->rockchip, size, 0);
 		if (!buf->bo) {
-			ALOGE("failed to allocate bo %dx%dx%dx%d\n",
-				handle->height, pitch, cpp, size);
+			ALOGE("failed to allocate bo %dx%dx%d\n",
+				handle->height, pitch, size);
 			goto err;
 		}
 
@@ -121,6 +138,7 @@ static struct gralloc_drm_bo_t *drm_gem_rockchip_alloc(
 
 	handle->name = 0;
 	handle->stride = pitch;
+	buf->base.size = size;
 	buf->base.handle = handle;
 
 	return &buf->base;
@@ -147,6 +165,25 @@ static void drm_gem_rockchip_free(struct gralloc_drm_drv_t *drv,
 	free(buf);
 }
 
+static int drm_gem_rockchip_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	int pitch;
+	uint32_t size;
+
+	UNUSED(drv);
+
+	if (drm_gem_rockchip_get_size(handle, &pitch, &size) ||
+	    !gralloc_drm_size_class_match(size, bo->size))
+		return -EINVAL;
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
+}
+
 static int drm_gem_rockchip_map(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
 		int enable_write, void **addr)
@@ -170,6 +207,16 @@ static void drm_gem_rockchip_unmap(struct gralloc_drm_drv_t *drv,
 	UNUSED(drv, bo);
 }
 
+static int drm_gem_rockchip_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write)
+{
+	UNUSED(drv, bo, x, y, w, h, enable_write);
+
+	/* the mapping is coherent and rockchip_bo_map does not wait */
+	return 0;
+}
+
 struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_rockchip(int fd)
 {
 	struct rockchip_info *info;
@@ -194,6 +241,9 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_rockchip(int fd)
 	info->base.free = drm_gem_rockchip_free;
 	info->base.map = drm_gem_rockchip_map;
 	info->base.unmap = drm_gem_rockchip_unmap;
+	info->base.redescribe = drm_gem_rockchip_redescribe;
+	info->base.begin_cpu_access = drm_gem_rockchip_begin_cpu_access;
+	info->base.prime_mappable = 1;
 
 	return &info->base;
 }
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Profiler of the waits for the GPU in buffer locks.  Drivers wait for
+ * the bo when mapping it, which hides the waits in the map time.  When
+ * gralloc.drm.stall_profile is set, the first map of a lock queries the
+ * bo first and, when busy, waits for it separately, so that the wait and
+ * the map are timed apart.  Locks are grouped by buffer, usage and thread,
+ * and the groups that waited the longest are kept.
+ */
+
+#define LOG_TAG "GRALLOC-STALL"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+#define STALL_TABLE_SIZE 256
+
+struct gralloc_drm_stall_table {
+	pthread_mutex_t mutex;
+	int count;
+	struct gralloc_drm_stall entries[STALL_TABLE_SIZE];
+};
+
+void gralloc_drm_stall_init(struct gralloc_drm_t *drm)
+{
+	char value[PROPERTY_VALUE_MAX];
+	struct gralloc_drm_stall_table *table;
+
+	property_get("gralloc.drm.stall_profile", value, "0");
+	if (!atoi(value))
+		return;
+
+	table = calloc(1, sizeof(*table));
+	if (!table)
+		return;
+
+	pthread_mutex_init(&table->mutex, NULL);
+	drm->stalls = table;
+
+	ALOGI("profiling lock stalls");
+}
+
+void gralloc_drm_stall_fini(struct gralloc_drm_t *drm)
+{
+	if (!drm->stalls)
+		return;
+
+	pthread_mutex_destroy(&drm->stalls->mutex);
+	free(drm->stalls);
+	drm->stalls = NULL;
+}
+
+/*
+ * Query whether CPU access to a bo would wait for the GPU or, with wait,
+ * block until it would not.  A dma-buf is readable once the GPU has
+ * stopped writing it, and writable once it has stopped accessing it.
+ */
+static int stall_busy(struct gralloc_drm_bo_t *bo, int write, int wait)
+{
+	struct gralloc_drm_drv_t *drv = bo->drv;
+	struct pollfd pfd;
+	int ret;
+
+	if (drv->busy)
+		return drv->busy(drv, bo, write, wait);
+
+	if (bo->handle->prime_fd < 0)
+		return -ENOSYS;
+
+	pfd.fd = bo->handle->prime_fd;
+	pfd.events = (write) ? POLLOUT : POLLIN;
+	pfd.revents = 0;
+	do {
+		ret = poll(&pfd, 1, (wait) ? -1 : 0);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+	if (ret < 0)
+		return -errno;
+
+	return (ret) ? 0 : -EBUSY;
+}
+
+/*
+ * Wait for a bo before its first map.  Return the time waited, 0 if the
+ * bo was idle or its state is unknown, or -1 if it was busy but the wait
+ * could not be separated from the map.
+ */
+int64_t gralloc_drm_stall_wait(struct gralloc_drm_bo_t *bo, int write)
+{
+	int64_t start, wait;
+
+	if (stall_busy(bo, write, 0) != -EBUSY)
+		return 0;
+
+	gralloc_drm_timeline_begin("stall");
+	start = gralloc_drm_get_time();
+	if (stall_busy(bo, write, 1))
+		wait = -1;
+	else
+		wait = gralloc_drm_get_time() - start;
+	gralloc_drm_timeline_end("stall");
+
+	/* a busy bo has always waited */
+	return (wait) ? wait : 1;
+}
+
+/*
+ * Return the entry of a group, or a new one.  When the table is full,
+ * the group that waited the least is replaced, but only by a group that
+ * has waited.  The table mutex must be held.
+ */
+static struct gralloc_drm_stall *stall_get_entry(
+		struct gralloc_drm_stall_table *table,
+		const struct gralloc_drm_stall *key, int stalled)
+{
+	struct gralloc_drm_stall *entry, *least = NULL;
+	int i;
+
+	for (i = 0; i < table->count; i++) {
+		entry = &table->entries[i];
+
+		if (entry->buffer == key->buffer &&
+		    entry->usage == key->usage &&
+		    entry->tid == key->tid &&
+		    entry->width == key->width &&
+		    entry->height == key->height &&
+		    entry->format == key->format)
+			return entry;
+
+		if (!least || least->wait_ns > entry->wait_ns)
+			least = entry;
+	}
+
+	if (table->count < STALL_TABLE_SIZE)
+		entry = &table->entries[table->count++];
+	else if (stalled && least->wait_ns == 0)
+		entry = least;
+	else
+		return NULL;
+
+	*entry = *key;
+
+	return entry;
+}
+
+/*
+ * Record the first map of a lock that started at start, after a wait
+ * returned by gralloc_drm_stall_wait.
+ */
+void gralloc_drm_stall_record(struct gralloc_drm_bo_t *bo, int usage,
+		int64_t wait, int64_t start)
+{
+	struct gralloc_drm_stall_table *table = bo->drm->stalls;
+	struct gralloc_drm_stall key, *entry;
+	int64_t map_ns = gralloc_drm_get_time() - start;
+
+	/* the map has waited */
+	if (wait < 0) {
+		wait = map_ns;
+		map_ns = 0;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.buffer = (uint64_t) (uintptr_t) bo;
+	key.width = bo->handle->width;
+	key.height = bo->handle->height;
+	key.format = bo->handle->format;
+	key.usage = usage;
+	key.tid = gettid();
+
+	pthread_mutex_lock(&table->mutex);
+
+	entry = stall_get_entry(table, &key, wait > 0);
+	if (entry) {
+		entry->maps++;
+		entry->map_ns += map_ns;
+		if (wait > 0) {
+			entry->stalls++;
+			entry->wait_ns += wait;
+			if (entry->max_wait_ns < wait)
+				entry->max_wait_ns = wait;
+		}
+	}
+
+	pthread_mutex_unlock(&table->mutex);
+}
+
+static int stall_compare(const void *a, const void *b)
+{
+	const struct gralloc_drm_stall *sa = (const struct gralloc_drm_stall *) a;
+	const struct gralloc_drm_stall *sb = (const struct gralloc_drm_stall *) b;
+
+	if (sa->wait_ns != sb->wait_ns)
+		return (sa->wait_ns > sb->wait_ns) ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Copy the groups that waited, longest first.  count is the size of
+ * stalls on entry and the number of groups copied on return.
+ */
+int gralloc_drm_get_stalls(struct gralloc_drm_t *drm,
+		struct gralloc_drm_stall *stalls, int *count)
+{
+	struct gralloc_drm_stall_table *table = drm->stalls;
+	struct gralloc_drm_stall *sorted;
+	int i, n = 0;
+
+	if (!table || *count < 0)
+		return -EINVAL;
+
+	sorted = malloc(sizeof(*sorted) * STALL_TABLE_SIZE);
+	if (!sorted)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&table->mutex);
+	for (i = 0; i < table->count; i++) {
+		if (table->entries[i].stalls)
+			sorted[n++] = table->entries[i];
+	}
+	pthread_mutex_unlock(&table->mutex);
+
+	qsort(sorted, n, sizeof(*sorted), stall_compare);
+
+	if (n > *count)
+		n = *count;
+	memcpy(stalls, sorted, sizeof(*sorted) * n);
+	*count = n;
+
+	free(sorted);
+
+	return 0;
+}
+
+/*
+ * Describe the top stalling buffers in buf, for dumpsys.  Return the
+ * length of the text, which is truncated to len - 1 bytes.
+ */
+int gralloc_drm_dump_stalls(struct gralloc_drm_t *drm, char *buf, int len)
+{
+	struct gralloc_drm_stall stalls[10];
+	struct gralloc_drm_dump_buf sb = { buf, len, 0 };
+	int count = 10, i;
+
+	if (len <= 0)
+		return -EINVAL;
+	buf[0] = '\0';
+
+	if (gralloc_drm_get_stalls(drm, stalls, &count))
+		return 0;
+
+	gralloc_drm_dump_printf(&sb, "top stalling buffers:\n");
+	for (i = 0; i < count; i++) {
+		const struct gralloc_drm_stall *s = &stalls[i];
+
+		gralloc_drm_dump_printf(&sb,
+				"  %#llx %dx%d format 0x%x usage 0x%x tid %d: "
+				"%d/%d maps waited %lld us (max %lld us), "
+				"mapped %lld us\n",
+				(unsigned long long) s->buffer, s->width,
+				s->height, s->format, s->usage, s->tid,
+				s->stalls, s->maps,
+				(long long) (s->wait_ns / 1000),
+				(long long) (s->max_wait_ns / 1000),
+				(long long) (s->map_ns / 1000));
+	}
+
+	return gralloc_drm_dump_length(&sb);
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Counters of the core.  They are always on: every update is a relaxed
+ * atomic add, and only allocations and first maps read the clock.
+ */
+
+#define LOG_TAG "GRALLOC-STATS"
+
+#include <log/log.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+static inline void stats_add(int64_t *counter, int64_t val)
+{
+	__atomic_fetch_add(counter, val, __ATOMIC_RELAXED);
+}
+
+static int stats_get_bucket(int64_t ns)
+{
+	int64_t us = ns / 1000;
+	int bucket = 0;
+
+	while (us && bucket < GRALLOC_DRM_STATS_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static int stats_get_usage_class(int usage)
+{
+	if (usage & GRALLOC_USAGE_HW_CAMERA_MASK)
+		return GRALLOC_DRM_STATS_USAGE_CAMERA;
+	if (usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+		return GRALLOC_DRM_STATS_USAGE_VIDEO;
+	if (usage & GRALLOC_USAGE_HW_FB)
+		return GRALLOC_DRM_STATS_USAGE_FB;
+	if (usage & GRALLOC_USAGE_HW_COMPOSER)
+		return GRALLOC_DRM_STATS_USAGE_COMPOSER;
+	if (usage & GRALLOC_USAGE_HW_RENDER)
+		return GRALLOC_DRM_STATS_USAGE_RENDER;
+	if (usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_2D))
+		return GRALLOC_DRM_STATS_USAGE_TEXTURE;
+
+	return GRALLOC_DRM_STATS_USAGE_SW;
+}
+
+/*
+ * Return the counter of the bytes of a format, claiming a free slot for a
+ * new format.
+ */
+static int64_t *stats_get_format_bytes(struct gralloc_drm_stats *stats,
+		int format)
+{
+	int i;
+
+	for (i = 0; i < GRALLOC_DRM_STATS_FORMATS; i++) {
+		int64_t *slot = &stats->bytes_by_format[i].format;
+		int64_t cur = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+		if (!cur && __atomic_compare_exchange_n(slot, &cur, format, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			cur = format;
+
+		if (cur == format)
+			return &stats->bytes_by_format[i].bytes;
+	}
+
+	return &stats->bytes_other_formats;
+}
+
+static void stats_add_bytes(struct gralloc_drm_stats *stats,
+		const struct gralloc_drm_bo_t *bo, int64_t sign)
+{
+	int64_t size = sign * gralloc_drm_bo_get_size(bo);
+
+	stats_add(&stats->bytes, size);
+	stats_add(&stats->bytes_by_usage[
+			stats_get_usage_class(bo->handle->usage)], size);
+	stats_add(stats_get_format_bytes(stats, bo->handle->format), size);
+}
+
+/*
+ * Count an allocation that started at start.  bo is NULL when it failed.
+ */
+void gralloc_drm_stats_alloc(struct gralloc_drm_t *drm,
+		struct gralloc_drm_drv_t *drv, struct gralloc_drm_bo_t *bo,
+		int64_t start, int cache_hit)
+{
+	struct gralloc_drm_stats *stats = &drm->stats;
+	int index = (drv && drv == drm->heap) ?
+		GRALLOC_DRM_STATS_DRV_HEAP : GRALLOC_DRM_STATS_DRV_GPU;
+
+	stats_add(&stats->alloc_latency[
+			stats_get_bucket(gralloc_drm_get_time() - start)], 1);
+
+	if (!bo) {
+		stats_add(&stats->alloc_failures, 1);
+		stats_add(&stats->drivers[index].failures, 1);
+		return;
+	}
+
+	stats_add(&stats->allocs, 1);
+	if (cache_hit)
+		stats_add(&stats->cache_hits, 1);
+	else
+		stats_add(&stats->drivers[index].allocs, 1);
+
+	stats_add_bytes(stats, bo, 1);
+}
+
+/*
+ * Count the free of a bo created by this process.
+ */
+void gralloc_drm_stats_free(struct gralloc_drm_bo_t *bo)
+{
+	struct gralloc_drm_stats *stats = &bo->drm->stats;
+
+	stats_add(&stats->frees, 1);
+	stats_add_bytes(stats, bo, -1);
+}
+
+void gralloc_drm_stats_import(struct gralloc_drm_t *drm, int err)
+{
+	stats_add((err) ? &drm->stats.import_failures : &drm->stats.imports,
+			1);
+}
+
+void gralloc_drm_stats_lock(struct gralloc_drm_t *drm, int usage, int err)
+{
+	struct gralloc_drm_stats *stats = &drm->stats;
+
+	if (err)
+		stats_add(&stats->lock_failures, 1);
+	else if (usage & GRALLOC_USAGE_SW_WRITE_MASK)
+		stats_add(&stats->locks_write, 1);
+	else if (usage & GRALLOC_USAGE_SW_READ_MASK)
+		stats_add(&stats->locks_read, 1);
+	else
+		stats_add(&stats->locks_hw, 1);
+}
+
+/*
+ * Count the map of a bo for its first lock, started at start.
+ */
+void gralloc_drm_stats_map(struct gralloc_drm_t *drm, int64_t start)
+{
+	stats_add(&drm->stats.map_latency[
+			stats_get_bucket(gralloc_drm_get_time() - start)], 1);
+}
+
+/*
+ * Snapshot the counters.  Each counter is read atomically, but they are
+ * not read at the same instant.
+ */
+void gralloc_drm_get_stats(struct gralloc_drm_t *drm,
+		struct gralloc_drm_stats *stats)
+{
+	const size_t first = offsetof(struct gralloc_drm_stats, allocs);
+	const size_t last = offsetof(struct gralloc_drm_stats, cached_bytes);
+	const int64_t *src = (const int64_t *) ((const char *) &drm->stats + first);
+	int64_t *dst = (int64_t *) ((char *) stats + first);
+	size_t i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->version = GRALLOC_DRM_STATS_VERSION;
+	stats->size = sizeof(*stats);
+
+	for (i = 0; i < (last - first) / sizeof(int64_t); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+	gralloc_drm_mutex_lock(&drm->cache_mutex);
+	stats->cached_bytes = drm->cache_bytes;
+	gralloc_drm_mutex_unlock(&drm->cache_mutex);
+
+	gralloc_drm_mutex_lock(&drm->map_mutex);
+	stats->mapped_bytes = drm->map_bytes;
+	gralloc_drm_mutex_unlock(&drm->map_mutex);
+}
+
+static const char *stats_usage_names[GRALLOC_DRM_STATS_USAGE_COUNT] = {
+	[GRALLOC_DRM_STATS_USAGE_CAMERA] = "camera",
+	[GRALLOC_DRM_STATS_USAGE_VIDEO] = "video",
+	[GRALLOC_DRM_STATS_USAGE_FB] = "fb",
+	[GRALLOC_DRM_STATS_USAGE_COMPOSER] = "composer",
+	[GRALLOC_DRM_STATS_USAGE_RENDER] = "render",
+	[GRALLOC_DRM_STATS_USAGE_TEXTURE] = "texture",
+	[GRALLOC_DRM_STATS_USAGE_SW] = "sw",
+};
+
+static const char *stats_drv_names[GRALLOC_DRM_STATS_DRV_COUNT] = {
+	[GRALLOC_DRM_STATS_DRV_GPU] = "gpu",
+	[GRALLOC_DRM_STATS_DRV_HEAP] = "heap",
+};
+
+static void stats_print_histogram(struct gralloc_drm_dump_buf *sb,
+		const char *name, const int64_t *buckets)
+{
+	int i, last = -1;
+
+	for (i = 0; i < GRALLOC_DRM_STATS_BUCKETS; i++) {
+		if (buckets[i])
+			last = i;
+	}
+
+	gralloc_drm_dump_printf(sb, "  %s (us):", name);
+	for (i = 0; i <= last; i++) {
+		if (i == GRALLOC_DRM_STATS_BUCKETS - 1)
+			gralloc_drm_dump_printf(sb, " >=%d:%lld", 1 << (i - 1),
+					(long long) buckets[i]);
+		else
+			gralloc_drm_dump_printf(sb, " <%d:%lld", 1 << i,
+					(long long) buckets[i]);
+	}
+	gralloc_drm_dump_printf(sb, "\n");
+}
+
+/*
+ * Describe the counters in buf, for dumpsys.  Return the length of the
+ * text, which is truncated to len - 1 bytes.
+ */
+int gralloc_drm_dump_stats(struct gralloc_drm_t *drm, char *buf, int len)
+{
+	struct gralloc_drm_stats stats;
+	struct gralloc_drm_dump_buf sb = { buf, len, 0 };
+	int i;
+
+	if (len <= 0)
+		return -EINVAL;
+	buf[0] = '\0';
+
+	gralloc_drm_get_stats(drm, &stats);
+
+	gralloc_drm_dump_printf(&sb, "gralloc_drm:\n");
+	gralloc_drm_dump_printf(&sb, "  allocs %lld (%lld from the cache), "
+			"failures %lld, frees %lld\n",
+			(long long) stats.allocs, (long long) stats.cache_hits,
+			(long long) stats.alloc_failures,
+			(long long) stats.frees);
+	gralloc_drm_dump_printf(&sb, "  imports %lld, failures %lld\n",
+			(long long) stats.imports,
+			(long long) stats.import_failures);
+	gralloc_drm_dump_printf(&sb, "  locks read %lld, write %lld, hw %lld, "
+			"failures %lld\n",
+			(long long) stats.locks_read,
+			(long long) stats.locks_write,
+			(long long) stats.locks_hw,
+			(long long) stats.lock_failures);
+	gralloc_drm_dump_printf(&sb, "  bytes %lld, cached %lld, mapped %lld\n",
+			(long long) stats.bytes,
+			(long long) stats.cached_bytes,
+			(long long) stats.mapped_bytes);
+
+	gralloc_drm_dump_printf(&sb, "  bytes by usage:");
+	for (i = 0; i < GRALLOC_DRM_STATS_USAGE_COUNT; i++) {
+		gralloc_drm_dump_printf(&sb, " %s %lld", stats_usage_names[i],
+				(long long) stats.bytes_by_usage[i]);
+	}
+	gralloc_drm_dump_printf(&sb, "\n");
+
+	gralloc_drm_dump_printf(&sb, "  bytes by format:");
+	for (i = 0; i < GRALLOC_DRM_STATS_FORMATS; i++) {
+		if (!stats.bytes_by_format[i].format)
+			break;
+		gralloc_drm_dump_printf(&sb, " 0x%llx %lld",
+				(long long) stats.bytes_by_format[i].format,
+				(long long) stats.bytes_by_format[i].bytes);
+	}
+	if (stats.bytes_other_formats)
+		gralloc_drm_dump_printf(&sb, " other %lld",
+				(long long) stats.bytes_other_formats);
+	gralloc_drm_dump_printf(&sb, "\n");
+
+	for (i = 0; i < GRALLOC_DRM_STATS_DRV_COUNT; i++) {
+		gralloc_drm_dump_printf(&sb,
+				"  %s allocs %lld, failures %lld\n",
+				stats_drv_names[i],
+				(long long) stats.drivers[i].allocs,
+				(long long) stats.drivers[i].failures);
+	}
+
+	stats_print_histogram(&sb, "alloc latency", stats.alloc_latency);
+	stats_print_histogram(&sb, "map latency", stats.map_latency);
+
+	return gralloc_drm_dump_length(&sb);
+}
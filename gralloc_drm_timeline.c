@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Timeline tracing.  When gralloc.drm.timeline is set to a path, the begin
+ * and end of the allocator and map operations are recorded in per-thread
+ * rings, and written on demand as a Chrome trace, which Perfetto opens as
+ * well.  Timestamps are CLOCK_MONOTONIC, as those of systrace.
+ *
+ * A ring is written by its thread only and read by the flush, so recording
+ * an event takes no lock.  A ring holds the last TIMELINE_RING_SIZE events
+ * since the previous flush; older ones are overwritten.
+ */
+
+#define LOG_TAG "GRALLOC-TIMELINE"
+
+#include <log/log.h>
+#include <cutils/properties.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+#define TIMELINE_RING_SIZE 2048 /* a power of two */
+
+struct timeline_event {
+	int64_t time;
+	const char *name;
+	int32_t phase;
+	int32_t tid;
+};
+
+struct timeline_ring {
+	struct timeline_ring *next;
+	int owned; /* by a live thread */
+
+	uint32_t head;    /* written by the owner only */
+	uint32_t flushed; /* under timeline_mutex */
+
+	struct timeline_event events[TIMELINE_RING_SIZE];
+};
+
+int gralloc_drm_timeline_enabled;
+
+static char timeline_path[PROPERTY_VALUE_MAX];
+static struct timeline_ring *timeline_rings;
+static pthread_key_t timeline_key;
+static pthread_once_t timeline_once = PTHREAD_ONCE_INIT;
+
+/* serializes flushes */
+static pthread_mutex_t timeline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int timeline_seq;
+
+/*
+ * Give the ring of an exiting thread to the next new thread.  Its events
+ * carry their tid and are still flushed.
+ */
+static void timeline_release_ring(void *data)
+{
+	struct timeline_ring *ring = (struct timeline_ring *) data;
+
+	__atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void timeline_init_once(void)
+{
+	property_get("gralloc.drm.timeline", timeline_path, "");
+	if (!timeline_path[0])
+		return;
+
+	if (pthread_key_create(&timeline_key, timeline_release_ring)) {
+		ALOGE("failed to create the timeline key");
+		return;
+	}
+
+	ALOGI("timeline tracing to %s", timeline_path);
+	__atomic_store_n(&gralloc_drm_timeline_enabled, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Read gralloc.drm.timeline.  Called by gralloc_drm_create.
+ */
+void gralloc_drm_timeline_init(void)
+{
+	pthread_once(&timeline_once, timeline_init_once);
+}
+
+static struct timeline_ring *timeline_get_ring(void)
+{
+	struct timeline_ring *ring;
+	int owned = 0;
+
+	ring = (struct timeline_ring *) pthread_getspecific(timeline_key);
+	if (ring)
+		return ring;
+
+	/* reuse the ring of a thread that has exited */
+	for (ring = __atomic_load_n(&timeline_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		owned = 0;
+		if (__atomic_compare_exchange_n(&ring->owned, &owned, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (!ring) {
+		ring = (struct timeline_ring *) calloc(1, sizeof(*ring));
+		if (!ring)
+			return NULL;
+		ring->owned = 1;
+
+		ring->next = __atomic_load_n(&timeline_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&timeline_rings,
+					&ring->next, ring, 0,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+
+	pthread_setspecific(timeline_key, ring);
+
+	return ring;
+}
+
+/*
+ * Record an event of the calling thread; phase is 'B' or 'E'.  name must
+ * be a string literal.
+ */
+void gralloc_drm_timeline_event(const char *name, int phase)
+{
+	struct timeline_ring *ring = timeline_get_ring();
+	struct timeline_event *ev;
+	uint32_t head;
+
+	if (!ring)
+		return;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	ev = &ring->events[head & (TIMELINE_RING_SIZE - 1)];
+	ev->time = gralloc_drm_get_time();
+	ev->name = name;
+	ev->phase = phase;
+	ev->tid = gettid();
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Write the events of a ring recorded since the last flush.  count is the
+ * number of events written so far.  timeline_mutex must be held.
+ */
+static void timeline_flush_ring(struct timeline_ring *ring, FILE *fp,
+		int *count)
+{
+	static struct timeline_event events[TIMELINE_RING_SIZE];
+	uint32_t start, head, cur, skip, n, i;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	start = ring->flushed;
+	if (head - start > TIMELINE_RING_SIZE)
+		start = head - TIMELINE_RING_SIZE;
+
+	n = head - start;
+	for (i = 0; i < n; i++)
+		events[i] = ring->events[(start + i) & (TIMELINE_RING_SIZE - 1)];
+
+	/* the owner may have overwritten the oldest events meanwhile */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	cur = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	skip = 0;
+	if (cur - start >= TIMELINE_RING_SIZE)
+		skip = cur - start - TIMELINE_RING_SIZE + 1;
+
+	for (i = skip; i < n; i++) {
+		const struct timeline_event *ev = &events[i];
+
+		fprintf(fp, "%s{\"name\": \"%s\", \"cat\": \"gralloc\", "
+				"\"ph\": \"%c\", \"ts\": %lld.%03d, "
+				"\"pid\": %d, \"tid\": %d}",
+				(*count) ? ",\n" : "", ev->name, ev->phase,
+				(long long) (ev->time / 1000),
+				(int) (ev->time % 1000), getpid(), ev->tid);
+		(*count)++;
+	}
+
+	ring->flushed = head;
+}
+
+/*
+ * Write the events recorded since the last flush to path, or to
+ * <gralloc.drm.timeline>.<pid>.<n>.json when path is NULL.
+ */
+int gralloc_drm_timeline_flush(const char *path)
+{
+	char name[PROPERTY_VALUE_MAX + 32];
+	struct timeline_ring *ring;
+	int count = 0, err = 0;
+	FILE *fp;
+
+	if (!__atomic_load_n(&gralloc_drm_timeline_enabled, __ATOMIC_ACQUIRE))
+		return -EINVAL;
+
+	pthread_mutex_lock(&timeline_mutex);
+
+	if (!path) {
+		snprintf(name, sizeof(name), "%s.%d.%d.json", timeline_path,
+				getpid(), timeline_seq++);
+		path = name;
+	}
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		err = -errno;
+		ALOGE("failed to open %s", path);
+		goto out;
+	}
+
+	fprintf(fp, "{\"traceEvents\": [\n");
+	for (ring = __atomic_load_n(&timeline_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next)
+		timeline_flush_ring(ring, fp, &count);
+	fprintf(fp, "\n],\n\"displayTimeUnit\": \"ns\"\n}\n");
+
+	if (fclose(fp)) {
+		err = -errno;
+		ALOGE("failed to write %s", path);
+		goto out;
+	}
+
+	ALOGI("wrote %d timeline events to %s", count, path);
+
+out:
+	pthread_mutex_unlock(&timeline_mutex);
+
+	return err;
+}
@@ -0,0 +1,71 @@
+# Copyright (C) 2026 The gralloc_drm Authors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+# Benchmarks and checks of the gralloc_drm core.  They run on the DRM
+# device or, with "-b soft", on a memfd-backed software driver that needs
+# no GPU.  host/Makefile builds them for the host, see there.
+
+LOCAL_PATH := $(call my-dir)
+
+gralloc_drm_bench_includes := \
+	$(LOCAL_PATH)/.. \
+	hardware/libhardware/include \
+	external/libdrm \
+	external/libdrm/include/drm
+
+gralloc_drm_bench_libraries := \
+	libgralloc_drm \
+	libdrm \
+	liblog \
+	libcutils
+
+gralloc_drm_bench_common := \
+	bench.c \
+	soft_drv.c
+
+# each tool is built from <tool>.c and the common sources
+gralloc_drm_tools := \
+	gralloc_drm_bench \
+	gralloc_drm_mtbench \
+	gralloc_drm_replay \
+	gralloc_drm_workload \
+	gralloc_drm_stress \
+	gralloc_drm_format_check
+
+# the HAL backend of the multithreaded benchmark loads the module
+gralloc_drm_mtbench_extra_libraries := libhardware
+
+define gralloc_drm_tool
+include $$(CLEAR_VARS)
+LOCAL_MODULE := $(1)
+LOCAL_MODULE_TAGS := optional
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_SRC_FILES := \
+	$$(gralloc_drm_bench_common) \
+	$(1).c
+LOCAL_C_INCLUDES := $$(gralloc_drm_bench_includes)
+LOCAL_SHARED_LIBRARIES := \
+	$$(gralloc_drm_bench_libraries) \
+	$$($(1)_extra_libraries)
+LOCAL_CFLAGS += -Wno-unused-parameter
+include $$(BUILD_EXECUTABLE)
+endef
+
+$(foreach tool,$(gralloc_drm_tools),$(eval $(call gralloc_drm_tool,$(tool))))
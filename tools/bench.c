@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Helpers shared by the gralloc_drm benchmarks.
+ */
+
+#define LOG_TAG "GRALLOC-BENCH"
+
+#include <log/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+int bench_samples_init(struct bench_samples *samples, int max)
+{
+	samples->ns = calloc(max, sizeof(*samples->ns));
+	samples->count = 0;
+	samples->max = (samples->ns) ? max : 0;
+
+	return (samples->ns) ? 0 : -1;
+}
+
+void bench_samples_fini(struct bench_samples *samples)
+{
+	free(samples->ns);
+	samples->ns = NULL;
+	samples->count = 0;
+	samples->max = 0;
+}
+
+void bench_samples_reset(struct bench_samples *samples)
+{
+	samples->count = 0;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+void bench_samples_get_stats(const struct bench_samples *samples,
+		struct bench_stats *stats)
+{
+	int64_t *sorted, total = 0;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!samples->count)
+		return;
+
+	sorted = malloc(samples->count * sizeof(*sorted));
+	if (!sorted)
+		return;
+
+	memcpy(sorted, samples->ns, samples->count * sizeof(*sorted));
+	qsort(sorted, samples->count, sizeof(*sorted), compare_ns);
+
+	for (i = 0; i < samples->count; i++)
+		total += sorted[i];
+
+	stats->count = samples->count;
+	stats->p50 = sorted[(samples->count - 1) * 50 / 100];
+	stats->p99 = sorted[(samples->count - 1) * 99 / 100];
+	stats->max = sorted[samples->count - 1];
+	stats->mean = (double) total / samples->count;
+	stats->ops_per_sec = (total) ?
+		samples->count * 1e9 / (double) total : 0.0;
+
+	free(sorted);
+}
+
+void bench_json_stats(FILE *fp, const char *name,
+		const struct bench_stats *stats)
+{
+	fprintf(fp, "\"%s\": {\"n\": %d, \"p50_ns\": %lld, \"p99_ns\": %lld, "
+			"\"max_ns\": %lld, \"mean_ns\": %.1f, "
+			"\"ops_per_sec\": %.1f}",
+			name, stats->count,
+			(long long) stats->p50, (long long) stats->p99,
+			(long long) stats->max, stats->mean,
+			stats->ops_per_sec);
+}
+
+int bench_get_formats(const int **formats)
+{
+	static int list[64];
+	static int count = -1;
+	const struct gralloc_drm_format *descs;
+	int n, i;
+
+	if (count < 0) {
+		n = gralloc_drm_get_formats(&descs);
+		count = 0;
+		for (i = 0; i < n && count < 64; i++)
+			list[count++] = descs[i].format;
+	}
+
+	*formats = list;
+
+	return count;
+}
+
+const char *bench_format_name(int format)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+	static char unknown[16];
+
+	if (desc)
+		return desc->name;
+
+	snprintf(unknown, sizeof(unknown), "0x%x", format);
+	return unknown;
+}
+
+int bench_format_is_ycbcr(int format)
+{
+	const struct gralloc_drm_format *desc = gralloc_drm_get_format(format);
+
+	return (desc && desc->num_planes > 1);
+}
+
+struct gralloc_drm_t *bench_create_drm(const char *backend)
+{
+	struct gralloc_drm_drv_t *drv;
+
+	if (!strcmp(backend, "drm"))
+		return gralloc_drm_create();
+
+	if (strcmp(backend, "soft")) {
+		fprintf(stderr, "unknown backend %s\n", backend);
+		return NULL;
+	}
+
+	drv = bench_create_soft_drv();
+	if (!drv)
+		return NULL;
+
+	return gralloc_drm_create_for_drv(drv);
+}
+
+buffer_handle_t bench_clone_handle(buffer_handle_t handle)
+{
+	struct gralloc_drm_handle_t *src = gralloc_drm_handle(handle);
+	struct gralloc_drm_handle_t *dst;
+
+	if (!src)
+		return NULL;
+
+	dst = malloc(sizeof(*dst));
+	if (!dst)
+		return NULL;
+
+	/* what binder would deliver: new fds and no local state */
+	memcpy(dst, src, sizeof(*dst));
+	dst->prime_fd = (src->prime_fd >= 0) ? dup(src->prime_fd) : -1;
+	dst->data = NULL;
+	dst->data_owner = 0;
+
+	return &dst->base;
+}
+
+void bench_free_clone(buffer_handle_t clone)
+{
+	struct gralloc_drm_handle_t *handle =
+		(struct gralloc_drm_handle_t *) clone;
+
+	if (handle->prime_fd >= 0)
+		close(handle->prime_fd);
+	free(handle);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Helpers shared by the gralloc_drm benchmarks.
+ */
+
+#ifndef _GRALLOC_DRM_BENCH_H_
+#define _GRALLOC_DRM_BENCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gralloc_drm.h"
+#include "gralloc_drm_priv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* latencies of an operation, in ns */
+struct bench_samples {
+	int64_t *ns;
+	int count;
+	int max;
+};
+
+struct bench_stats {
+	int count;
+	int64_t p50;
+	int64_t p99;
+	int64_t max;
+	double mean;
+	double ops_per_sec; /* back to back, from the sum of the latencies */
+};
+
+int bench_samples_init(struct bench_samples *samples, int max);
+void bench_samples_fini(struct bench_samples *samples);
+void bench_samples_reset(struct bench_samples *samples);
+
+static inline void bench_samples_add(struct bench_samples *samples,
+		int64_t ns)
+{
+	if (samples->count < samples->max)
+		samples->ns[samples->count++] = ns;
+}
+
+void bench_samples_get_stats(const struct bench_samples *samples,
+		struct bench_stats *stats);
+void bench_json_stats(FILE *fp, const char *name,
+		const struct bench_stats *stats);
+
+/* the formats gralloc_drm_get_bpp knows about, in a static array */
+int bench_get_formats(const int **formats);
+const char *bench_format_name(int format);
+int bench_format_is_ycbcr(int format);
+
+/* "drm" for the DRM device, "soft" for the software driver */
+struct gralloc_drm_t *bench_create_drm(const char *backend);
+struct gralloc_drm_drv_t *bench_create_soft_drv(void);
+
+/* a copy of a handle as another process would receive it */
+buffer_handle_t bench_clone_handle(buffer_handle_t handle);
+void bench_free_clone(buffer_handle_t clone);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _GRALLOC_DRM_BENCH_H_ */
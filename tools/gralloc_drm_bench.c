@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Latency and throughput of the gralloc_drm core API, over a matrix of
+ * formats, sizes and usages.  Results are written as JSON.
+ *
+ *   gralloc_drm_bench [-b drm|soft] [-n iterations] [-o file]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+enum {
+	OP_CREATE,
+	OP_REGISTER,
+	OP_LOCK,
+	OP_UNLOCK,
+	OP_LOCK_YCBCR,
+	OP_UNREGISTER,
+	OP_FREE,
+	OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+	[OP_CREATE] = "create",
+	[OP_REGISTER] = "register",
+	[OP_LOCK] = "lock",
+	[OP_UNLOCK] = "unlock",
+	[OP_LOCK_YCBCR] = "lock_ycbcr",
+	[OP_UNREGISTER] = "unregister",
+	[OP_FREE] = "free",
+};
+
+static const struct {
+	int width, height;
+} sizes[] = {
+	{ 64, 64 },
+	{ 256, 256 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+
+static const struct {
+	const char *name;
+	int usage;
+} usages[] = {
+	{ "sw", GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN },
+	{ "texture", GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_WRITE_OFTEN },
+	{ "render", GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+		GRALLOC_USAGE_SW_READ_RARELY },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/*
+ * Run the life cycle of a buffer: create, import in a "remote" handle,
+ * lock and unlock, and free.  Return -1 when the combination is not
+ * supported.
+ */
+static int run_once(struct gralloc_drm_t *drm, int format, int width,
+		int height, int usage, struct bench_samples *samples)
+{
+	struct gralloc_drm_bo_t *bo;
+	buffer_handle_t handle, clone;
+	int lock_usage, stride;
+	int64_t t;
+
+	lock_usage = usage & (GRALLOC_USAGE_SW_READ_MASK |
+			      GRALLOC_USAGE_SW_WRITE_MASK);
+
+	t = gralloc_drm_get_time();
+	bo = gralloc_drm_bo_create(drm, width, height, format, usage);
+	bench_samples_add(&samples[OP_CREATE], gralloc_drm_get_time() - t);
+	if (!bo)
+		return -1;
+
+	handle = gralloc_drm_bo_get_handle(bo, &stride);
+	clone = bench_clone_handle(handle);
+
+	if (clone) {
+		t = gralloc_drm_get_time();
+		if (!gralloc_drm_handle_register(clone, drm)) {
+			bench_samples_add(&samples[OP_REGISTER],
+					gralloc_drm_get_time() - t);
+		}
+		else {
+			bench_free_clone(clone);
+			clone = NULL;
+		}
+	}
+
+	if (lock_usage) {
+		void *ptr;
+
+		t = gralloc_drm_get_time();
+		if (!gralloc_drm_bo_lock(bo, lock_usage, 0, 0, width, height,
+					&ptr)) {
+			bench_samples_add(&samples[OP_LOCK],
+					gralloc_drm_get_time() - t);
+
+			t = gralloc_drm_get_time();
+			gralloc_drm_bo_unlock(bo);
+			bench_samples_add(&samples[OP_UNLOCK],
+					gralloc_drm_get_time() - t);
+		}
+	}
+
+	if (lock_usage && bench_format_is_ycbcr(format)) {
+		struct android_ycbcr ycbcr;
+
+		t = gralloc_drm_get_time();
+		if (!gralloc_drm_bo_lock_ycbcr(bo, lock_usage, 0, 0,
+					width, height, &ycbcr)) {
+			bench_samples_add(&samples[OP_LOCK_YCBCR],
+					gralloc_drm_get_time() - t);
+			gralloc_drm_bo_unlock(bo);
+		}
+	}
+
+	if (clone) {
+		t = gralloc_drm_get_time();
+		gralloc_drm_handle_unregister(clone);
+		bench_samples_add(&samples[OP_UNREGISTER],
+				gralloc_drm_get_time() - t);
+		bench_free_clone(clone);
+	}
+
+	t = gralloc_drm_get_time();
+	gralloc_drm_bo_decref(bo);
+	bench_samples_add(&samples[OP_FREE], gralloc_drm_get_time() - t);
+
+	return 0;
+}
+
+static void usage_exit(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b drm|soft] [-n iterations] [-o file]\n",
+			prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_samples samples[OP_COUNT];
+	const char *backend = "drm";
+	struct gralloc_drm_t *drm;
+	const int *formats;
+	int format_count, iterations = 100;
+	int f, s, u, i, op, first = 1;
+	FILE *fp = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:o:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'o':
+			fp = fopen(optarg, "w");
+			if (!fp) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage_exit(argv[0]);
+			break;
+		}
+	}
+
+	if (iterations <= 0)
+		usage_exit(argv[0]);
+
+	drm = bench_create_drm(backend);
+	if (!drm) {
+		fprintf(stderr, "failed to create the %s backend\n", backend);
+		return 1;
+	}
+
+	for (op = 0; op < OP_COUNT; op++) {
+		if (bench_samples_init(&samples[op], iterations))
+			return 1;
+	}
+
+	fprintf(fp, "{\n\"benchmark\": \"gralloc_drm_bench\",\n"
+			"\"backend\": \"%s\",\n\"iterations\": %d,\n"
+			"\"results\": [\n", backend, iterations);
+
+	format_count = bench_get_formats(&formats);
+	for (f = 0; f < format_count; f++) {
+		for (s = 0; s < (int) ARRAY_SIZE(sizes); s++) {
+			for (u = 0; u < (int) ARRAY_SIZE(usages); u++) {
+				for (op = 0; op < OP_COUNT; op++)
+					bench_samples_reset(&samples[op]);
+
+				for (i = 0; i < iterations; i++) {
+					if (run_once(drm, formats[f],
+						     sizes[s].width,
+						     sizes[s].height,
+						     usages[u].usage, samples))
+						break;
+				}
+
+				fprintf(fp, "%s{\"format\": \"%s\", "
+						"\"width\": %d, \"height\": %d, "
+						"\"usage\": \"%s\", "
+						"\"supported\": %s",
+						(first) ? "" : ",\n",
+						bench_format_name(formats[f]),
+						sizes[s].width, sizes[s].height,
+						usages[u].name,
+						(i == iterations) ?
+							"true" : "false");
+				first = 0;
+
+				for (op = 0; op < OP_COUNT; op++) {
+					struct bench_stats stats;
+
+					if (!samples[op].count)
+						continue;
+
+					bench_samples_get_stats(&samples[op],
+							&stats);
+					fprintf(fp, ", ");
+					bench_json_stats(fp, op_names[op],
+							&stats);
+				}
+				fprintf(fp, "}");
+			}
+		}
+	}
+
+	fprintf(fp, "\n]\n}\n");
+
+	for (op = 0; op < OP_COUNT; op++)
+		bench_samples_fini(&samples[op]);
+	gralloc_drm_destroy(drm);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Check of the format resolution and of the layouts of the format table.
+ * It needs no device.
+ *
+ *   gralloc_drm_format_check
+ *
+ * The exit status is 0 when no check failed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <hardware/gralloc.h>
+
+#include "bench.h"
+
+struct alloc_format_case {
+	const char *name;
+	int format;
+	int usage;
+	int expected;
+};
+
+static const struct alloc_format_case alloc_format_cases[] = {
+	{ "camera to encoder", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_VIDEO_ENCODER,
+	  HAL_PIXEL_FORMAT_YCbCr_420_888 },
+	{ "camera ZSL", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_CAMERA_ZSL,
+	  HAL_PIXEL_FORMAT_YCbCr_420_888 },
+	{ "camera to composer", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_COMPOSER,
+	  HAL_PIXEL_FORMAT_YCbCr_420_888 },
+	/* the input surfaces of encoders, screenrecord, virtual displays */
+	{ "GPU to encoder", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_HW_RENDER,
+	  HAL_PIXEL_FORMAT_RGBX_8888 },
+	{ "camera to GPU", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_CAMERA_WRITE | GRALLOC_USAGE_HW_TEXTURE,
+	  HAL_PIXEL_FORMAT_RGBX_8888 },
+	{ "composition", HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+	  GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER,
+	  HAL_PIXEL_FORMAT_RGBX_8888 },
+	{ "explicit format", HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_HW_VIDEO_ENCODER,
+	  HAL_PIXEL_FORMAT_RGBA_8888 },
+};
+
+struct layout_case {
+	int format;
+	int height;
+	int stride;
+	int num_planes;
+	uint32_t cb_offset;
+	uint32_t cr_offset;
+	int chroma_step;
+	size_t size;
+};
+
+static const struct layout_case layout_cases[] = {
+	{ HAL_PIXEL_FORMAT_YV12, 2160, 3840, 3,
+	  3840 * 2160 * 5 / 4, 3840 * 2160, 1, 3840 * 2160 * 3 / 2 },
+	{ HAL_PIXEL_FORMAT_YCbCr_420_888, 2160, 3840, 2,
+	  3840 * 2160, 3840 * 2160 + 1, 2, 3840 * 2160 * 3 / 2 },
+	{ HAL_PIXEL_FORMAT_YCrCb_420_SP, 2160, 3840, 2,
+	  3840 * 2160 + 1, 3840 * 2160, 2, 3840 * 2160 * 3 / 2 },
+	{ HAL_PIXEL_FORMAT_YCbCr_422_SP, 2160, 3840, 2,
+	  3840 * 2160, 3840 * 2160 + 1, 2, 3840 * 2160 * 2 },
+	{ HAL_PIXEL_FORMAT_YCBCR_P010, 2160, 7680, 2,
+	  7680 * 2160, 7680 * 2160 + 2, 4, 7680 * 2160 * 3 / 2 },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static int check_alloc_formats(void)
+{
+	unsigned i;
+	int failures = 0;
+
+	for (i = 0; i < ARRAY_SIZE(alloc_format_cases); i++) {
+		const struct alloc_format_case *c = &alloc_format_cases[i];
+		int format = gralloc_drm_get_alloc_format(c->format, c->usage);
+
+		if (format != c->expected) {
+			fprintf(stderr, "%s: usage 0x%x resolved to %s, "
+					"not %s\n", c->name, c->usage,
+					bench_format_name(format),
+					bench_format_name(c->expected));
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+static int check_layouts(void)
+{
+	struct gralloc_drm_layout layout;
+	unsigned i;
+	int failures = 0;
+
+	for (i = 0; i < ARRAY_SIZE(layout_cases); i++) {
+		const struct layout_case *c = &layout_cases[i];
+
+		if (gralloc_drm_get_layout(c->format, c->height, c->stride,
+					&layout) != c->num_planes ||
+		    layout.cb_offset != c->cb_offset ||
+		    layout.cr_offset != c->cr_offset ||
+		    layout.chroma_step != c->chroma_step ||
+		    layout.size != c->size) {
+			fprintf(stderr, "%s: %d planes, Cb at %u, Cr at %u, "
+					"step %d, %zu bytes\n",
+					bench_format_name(c->format),
+					layout.num_planes, layout.cb_offset,
+					layout.cr_offset, layout.chroma_step,
+					layout.size);
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int failures = 0;
+
+	failures += check_alloc_formats();
+	failures += check_layouts();
+
+	printf("%d failures\n", failures);
+
+	return (failures) ? 1 : 0;
+}
@@ -0,0 +1,542 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Scaling of register, lock and alloc/free when many threads, like the
+ * binder threads of SurfaceFlinger or the media server, use gralloc at
+ * once.  Each scenario runs for a while at 1, 2, 4, ... threads on shared
+ * or per-thread buffers, and reports the throughput per core and the tail
+ * latency as JSON.  Scenarios that stop scaling are flagged with the locks
+ * on their path.
+ *
+ *   gralloc_drm_mtbench [-b drm|soft|hal] [-t max_threads] [-d ms] [-o file]
+ *
+ * "hal" goes through the gralloc module, and thus drm_mod_* and drm_init.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <hardware/gralloc.h>
+
+#include "bench.h"
+
+#define BUFFERS_PER_SET 4
+#define MAX_SAMPLES (64 * 1024)
+
+/* the buffer API, either the core or the gralloc module */
+struct api {
+	int (*alloc)(struct api *api, int w, int h, int format, int usage,
+		     buffer_handle_t *handle);
+	void (*free)(struct api *api, buffer_handle_t handle);
+	int (*reg)(struct api *api, buffer_handle_t handle);
+	int (*unreg)(struct api *api, buffer_handle_t handle);
+	int (*lock)(struct api *api, buffer_handle_t handle, int usage,
+		    int w, int h, void **ptr);
+	int (*unlock)(struct api *api, buffer_handle_t handle);
+
+	struct gralloc_drm_t *drm;
+	const gralloc_module_t *module;
+	alloc_device_t *alloc_dev;
+};
+
+static int core_alloc(struct api *api, int w, int h, int format, int usage,
+		buffer_handle_t *handle)
+{
+	struct gralloc_drm_bo_t *bo;
+
+	bo = gralloc_drm_bo_create(api->drm, w, h, format, usage);
+	if (!bo)
+		return -ENOMEM;
+
+	*handle = gralloc_drm_bo_get_handle(bo, NULL);
+
+	return 0;
+}
+
+static void core_free(struct api *api, buffer_handle_t handle)
+{
+	struct gralloc_drm_bo_t *bo = gralloc_drm_bo_from_handle(handle);
+
+	if (bo)
+		gralloc_drm_bo_decref(bo);
+}
+
+static int core_reg(struct api *api, buffer_handle_t handle)
+{
+	return gralloc_drm_handle_register(handle, api->drm);
+}
+
+static int core_unreg(struct api *api, buffer_handle_t handle)
+{
+	return gralloc_drm_handle_unregister(handle);
+}
+
+static int core_lock(struct api *api, buffer_handle_t handle, int usage,
+		int w, int h, void **ptr)
+{
+	struct gralloc_drm_bo_t *bo = gralloc_drm_bo_from_handle(handle);
+
+	return (bo) ? gralloc_drm_bo_lock(bo, usage, 0, 0, w, h, ptr) : -EINVAL;
+}
+
+static int core_unlock(struct api *api, buffer_handle_t handle)
+{
+	struct gralloc_drm_bo_t *bo = gralloc_drm_bo_from_handle(handle);
+
+	if (!bo)
+		return -EINVAL;
+
+	gralloc_drm_bo_unlock(bo);
+
+	return 0;
+}
+
+static int hal_alloc(struct api *api, int w, int h, int format, int usage,
+		buffer_handle_t *handle)
+{
+	int stride;
+
+	return api->alloc_dev->alloc(api->alloc_dev, w, h, format, usage,
+			handle, &stride);
+}
+
+static void hal_free(struct api *api, buffer_handle_t handle)
+{
+	api->alloc_dev->free(api->alloc_dev, handle);
+}
+
+static int hal_reg(struct api *api, buffer_handle_t handle)
+{
+	return api->module->registerBuffer(api->module, handle);
+}
+
+static int hal_unreg(struct api *api, buffer_handle_t handle)
+{
+	return api->module->unregisterBuffer(api->module, handle);
+}
+
+static int hal_lock(struct api *api, buffer_handle_t handle, int usage,
+		int w, int h, void **ptr)
+{
+	return api->module->lock(api->module, handle, usage, 0, 0, w, h, ptr);
+}
+
+static int hal_unlock(struct api *api, buffer_handle_t handle)
+{
+	return api->module->unlock(api->module, handle);
+}
+
+static int api_init(struct api *api, const char *backend)
+{
+	memset(api, 0, sizeof(*api));
+
+	if (!strcmp(backend, "hal")) {
+		const hw_module_t *module;
+
+		if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) ||
+		    gralloc_open(module, &api->alloc_dev))
+			return -1;
+
+		api->module = (const gralloc_module_t *) module;
+		api->alloc = hal_alloc;
+		api->free = hal_free;
+		api->reg = hal_reg;
+		api->unreg = hal_unreg;
+		api->lock = hal_lock;
+		api->unlock = hal_unlock;
+	}
+	else {
+		api->drm = bench_create_drm(backend);
+		if (!api->drm)
+			return -1;
+
+		api->alloc = core_alloc;
+		api->free = core_free;
+		api->reg = core_reg;
+		api->unreg = core_unreg;
+		api->lock = core_lock;
+		api->unlock = core_unlock;
+	}
+
+	return 0;
+}
+
+static void api_fini(struct api *api)
+{
+	if (api->alloc_dev)
+		gralloc_close(api->alloc_dev);
+	if (api->drm)
+		gralloc_drm_destroy(api->drm);
+}
+
+enum scenario_type {
+	ALLOC_FREE,
+	REGISTER,
+	LOCK_READ,
+	LOCK_WRITE,
+};
+
+static const struct scenario {
+	const char *name;
+	enum scenario_type type;
+	int shared;
+	const char *locks; /* on the path, to look at when it does not scale */
+} scenarios[] = {
+	{ "alloc_free", ALLOC_FREE, 0,
+		"drm_module_t::mutex (drm_init), gralloc_drm_t::cache_mutex, "
+		"pipe_manager::mutex, kernel GEM locks" },
+	{ "register_shared", REGISTER, 1,
+		"gralloc_drm_t::import_mutex, bo refcount cache line" },
+	{ "register_disjoint", REGISTER, 0,
+		"gralloc_drm_t::import_mutex" },
+	{ "lock_shared", LOCK_READ, 1,
+		"bo lock_state cache line, gralloc_drm_bo_t::lock_mutex, "
+		"pipe_manager::mutex" },
+	{ "lock_disjoint", LOCK_WRITE, 0,
+		"gralloc_drm_bo_t::lock_mutex, gralloc_drm_t::map_mutex, "
+		"pipe_manager::mutex" },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define BUF_WIDTH 256
+#define BUF_HEIGHT 256
+#define BUF_FORMAT HAL_PIXEL_FORMAT_RGBA_8888
+#define BUF_USAGE (GRALLOC_USAGE_HW_TEXTURE | \
+		   GRALLOC_USAGE_SW_READ_OFTEN | \
+		   GRALLOC_USAGE_SW_WRITE_OFTEN)
+
+struct worker {
+	pthread_t thread;
+	struct api *api;
+	const struct scenario *scenario;
+	pthread_barrier_t *barrier;
+	volatile int *stop;
+
+	buffer_handle_t *buffers; /* BUFFERS_PER_SET of them */
+	struct bench_samples samples;
+	long long ops;
+	int err;
+};
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct api *api = w->api;
+	int i = 0;
+
+	pthread_barrier_wait(w->barrier);
+
+	while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+		buffer_handle_t handle = w->buffers[i++ % BUFFERS_PER_SET];
+		buffer_handle_t clone = NULL;
+		void *ptr;
+		int64_t t;
+		int err = 0;
+
+		/* copies are made off the clock */
+		if (w->scenario->type == REGISTER) {
+			clone = bench_clone_handle(handle);
+			if (!clone) {
+				w->err = -ENOMEM;
+				break;
+			}
+		}
+
+		t = gralloc_drm_get_time();
+
+		switch (w->scenario->type) {
+		case ALLOC_FREE:
+			err = api->alloc(api, BUF_WIDTH, BUF_HEIGHT,
+					BUF_FORMAT, BUF_USAGE, &handle);
+			if (!err)
+				api->free(api, handle);
+			break;
+		case REGISTER:
+			err = api->reg(api, clone);
+			if (!err)
+				api->unreg(api, clone);
+			break;
+		case LOCK_READ:
+		case LOCK_WRITE:
+			err = api->lock(api, handle,
+					(w->scenario->type == LOCK_READ) ?
+					GRALLOC_USAGE_SW_READ_OFTEN :
+					GRALLOC_USAGE_SW_WRITE_OFTEN,
+					BUF_WIDTH, BUF_HEIGHT, &ptr);
+			if (!err)
+				api->unlock(api, handle);
+			break;
+		}
+
+		bench_samples_add(&w->samples, gralloc_drm_get_time() - t);
+
+		if (clone)
+			bench_free_clone(clone);
+
+		if (err) {
+			w->err = err;
+			break;
+		}
+
+		w->ops++;
+	}
+
+	return NULL;
+}
+
+struct result {
+	double ops_per_sec;
+	struct bench_stats stats;
+	int err;
+};
+
+static int alloc_set(struct api *api, buffer_handle_t *set)
+{
+	int i;
+
+	for (i = 0; i < BUFFERS_PER_SET; i++) {
+		if (api->alloc(api, BUF_WIDTH, BUF_HEIGHT, BUF_FORMAT,
+					BUF_USAGE, &set[i])) {
+			while (i--)
+				api->free(api, set[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void free_set(struct api *api, buffer_handle_t *set)
+{
+	int i;
+
+	for (i = 0; i < BUFFERS_PER_SET; i++)
+		api->free(api, set[i]);
+}
+
+static int run_scenario(struct api *api, const struct scenario *scenario,
+		int thread_count, int duration_ms, struct result *result)
+{
+	buffer_handle_t shared[BUFFERS_PER_SET];
+	struct bench_samples all;
+	pthread_barrier_t barrier;
+	struct worker *workers;
+	volatile int stop = 0;
+	long long ops = 0;
+	int64_t start, elapsed;
+	int i, j;
+
+	memset(result, 0, sizeof(*result));
+
+	workers = calloc(thread_count, sizeof(*workers));
+	if (!workers)
+		return -1;
+
+	if (scenario->shared && alloc_set(api, shared)) {
+		free(workers);
+		return -1;
+	}
+
+	pthread_barrier_init(&barrier, NULL, thread_count + 1);
+
+	for (i = 0; i < thread_count; i++) {
+		struct worker *w = &workers[i];
+
+		w->api = api;
+		w->scenario = scenario;
+		w->barrier = &barrier;
+		w->stop = &stop;
+		bench_samples_init(&w->samples, MAX_SAMPLES);
+
+		if (scenario->shared) {
+			w->buffers = shared;
+		}
+		else {
+			w->buffers = calloc(BUFFERS_PER_SET,
+					sizeof(*w->buffers));
+			if (!w->buffers || alloc_set(api, w->buffers))
+				w->err = -ENOMEM;
+		}
+
+		pthread_create(&w->thread, NULL, worker_run, w);
+	}
+
+	pthread_barrier_wait(&barrier);
+	start = gralloc_drm_get_time();
+	usleep(duration_ms * 1000);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < thread_count; i++)
+		pthread_join(workers[i].thread, NULL);
+	elapsed = gralloc_drm_get_time() - start;
+
+	bench_samples_init(&all, thread_count * MAX_SAMPLES);
+	for (i = 0; i < thread_count; i++) {
+		struct worker *w = &workers[i];
+
+		for (j = 0; j < w->samples.count; j++)
+			bench_samples_add(&all, w->samples.ns[j]);
+		bench_samples_fini(&w->samples);
+
+		ops += w->ops;
+		if (w->err && !result->err)
+			result->err = w->err;
+
+		if (!scenario->shared && w->buffers) {
+			if (w->err != -ENOMEM)
+				free_set(api, w->buffers);
+			free(w->buffers);
+		}
+	}
+
+	bench_samples_get_stats(&all, &result->stats);
+	bench_samples_fini(&all);
+	result->ops_per_sec = (elapsed) ? ops * 1e9 / elapsed : 0.0;
+
+	if (scenario->shared)
+		free_set(api, shared);
+	pthread_barrier_destroy(&barrier);
+	free(workers);
+
+	return 0;
+}
+
+static void usage_exit(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b drm|soft|hal] [-t max_threads] "
+			"[-d ms] [-o file]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *backend = "drm";
+	int max_threads = 32, duration_ms = 500;
+	int cpus, s, threads, first = 1;
+	FILE *fp = stdout;
+	struct api api;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:t:d:o:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration_ms = atoi(optarg);
+			break;
+		case 'o':
+			fp = fopen(optarg, "w");
+			if (!fp) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage_exit(argv[0]);
+			break;
+		}
+	}
+
+	if (max_threads <= 0 || duration_ms <= 0)
+		usage_exit(argv[0]);
+
+	if (api_init(&api, backend)) {
+		fprintf(stderr, "failed to create the %s backend\n", backend);
+		return 1;
+	}
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+
+	fprintf(fp, "{\n\"benchmark\": \"gralloc_drm_mtbench\",\n"
+			"\"backend\": \"%s\",\n\"cpus\": %d,\n"
+			"\"duration_ms\": %d,\n\"results\": [\n",
+			backend, cpus, duration_ms);
+
+	for (s = 0; s < (int) ARRAY_SIZE(scenarios); s++) {
+		const struct scenario *scenario = &scenarios[s];
+		double base = 0.0;
+
+		for (threads = 1; threads <= max_threads; threads *= 2) {
+			struct result result;
+			double per_core, efficiency;
+			int cores;
+
+			if (run_scenario(&api, scenario, threads,
+						duration_ms, &result)) {
+				fprintf(stderr, "failed to run %s\n",
+						scenario->name);
+				break;
+			}
+
+			if (threads == 1)
+				base = result.ops_per_sec;
+
+			/* linear scaling up to the number of cores */
+			cores = (threads < cpus) ? threads : cpus;
+			per_core = result.ops_per_sec / cores;
+			efficiency = (base > 0.0) ?
+				result.ops_per_sec / (base * cores) : 0.0;
+
+			fprintf(fp, "%s{\"scenario\": \"%s\", \"threads\": %d, "
+					"\"ops_per_sec\": %.1f, "
+					"\"ops_per_sec_per_core\": %.1f, "
+					"\"efficiency\": %.3f, "
+					"\"error\": %d, ",
+					(first) ? "" : ",\n", scenario->name,
+					threads, result.ops_per_sec, per_core,
+					efficiency, result.err);
+			first = 0;
+			bench_json_stats(fp, "latency", &result.stats);
+
+			/* less than half of the ideal throughput */
+			if (threads > 1 && efficiency < 0.5) {
+				fprintf(fp, ", \"convoy\": true, "
+						"\"suspects\": \"%s\"",
+						scenario->locks);
+			}
+			else {
+				fprintf(fp, ", \"convoy\": false");
+			}
+			fprintf(fp, "}");
+		}
+	}
+
+	fprintf(fp, "\n]\n}\n");
+
+	api_fini(&api);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replay a trace recorded with gralloc.drm.record against the gralloc_drm
+ * core.  Records are replayed one at a time in file order, so two runs on
+ * the same trace issue the same calls.  Buffers that the recorded process
+ * only imported are created locally and imported through a copy of their
+ * handle.  The recorded and replayed latencies are written as JSON.
+ *
+ *   gralloc_drm_replay [-b drm|soft] [-r] [-o file] trace
+ *
+ * With -r, records are issued at their recorded times instead of back to
+ * back.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+
+#include "bench.h"
+#include "gralloc_drm_record.h"
+
+#define OP_COUNT (GRALLOC_DRM_RECORD_UNLOCK + 1)
+
+static const char *op_names[OP_COUNT] = {
+	[GRALLOC_DRM_RECORD_ALLOC] = "alloc",
+	[GRALLOC_DRM_RECORD_FREE] = "free",
+	[GRALLOC_DRM_RECORD_REGISTER] = "register",
+	[GRALLOC_DRM_RECORD_UNREGISTER] = "unregister",
+	[GRALLOC_DRM_RECORD_LOCK] = "lock",
+	[GRALLOC_DRM_RECORD_LOCK_YCBCR] = "lock_ycbcr",
+	[GRALLOC_DRM_RECORD_UNLOCK] = "unlock",
+};
+
+/* a buffer of the trace */
+struct replay_buffer {
+	uint64_t id;
+
+	/* allocated by the recorded process, or created to be imported */
+	struct gralloc_drm_bo_t *bo;
+	int owned;
+
+	/* the imported copy of the handle */
+	buffer_handle_t clone;
+	int registered;
+
+	/* the bo the last lock went through */
+	struct gralloc_drm_bo_t *locked;
+};
+
+struct replay {
+	struct gralloc_drm_t *drm;
+
+	struct replay_buffer *buffers;
+	int count, max;
+
+	struct bench_samples recorded[OP_COUNT];
+	struct bench_samples replayed[OP_COUNT];
+
+	int records;
+	int skipped;  /* failed when recorded */
+	int failed;   /* failed only when replayed */
+	int unknown;  /* on a buffer that is not in the trace */
+	int live, peak_live;
+};
+
+static struct replay_buffer *replay_find(struct replay *rp, uint64_t id)
+{
+	int i;
+
+	for (i = 0; i < rp->count; i++) {
+		if (rp->buffers[i].id == id)
+			return &rp->buffers[i];
+	}
+
+	return NULL;
+}
+
+static struct replay_buffer *replay_add(struct replay *rp, uint64_t id)
+{
+	struct replay_buffer *buf;
+
+	if (rp->count == rp->max) {
+		int max = (rp->max) ? rp->max * 2 : 64;
+
+		buf = realloc(rp->buffers, sizeof(*buf) * max);
+		if (!buf)
+			return NULL;
+		rp->buffers = buf;
+		rp->max = max;
+	}
+
+	buf = &rp->buffers[rp->count++];
+	memset(buf, 0, sizeof(*buf));
+	buf->id = id;
+
+	rp->live++;
+	if (rp->peak_live < rp->live)
+		rp->peak_live = rp->live;
+
+	return buf;
+}
+
+/*
+ * Forget a buffer once neither the owner nor the import is left.  The id
+ * may be reused by a later buffer.
+ */
+static void replay_put(struct replay *rp, struct replay_buffer *buf)
+{
+	if (buf->bo || buf->registered)
+		return;
+
+	if (buf->clone)
+		bench_free_clone(buf->clone);
+
+	*buf = rp->buffers[--rp->count];
+	rp->live--;
+}
+
+/*
+ * Return the bo to lock a buffer through: the import when there is one.
+ */
+static struct gralloc_drm_bo_t *replay_get_bo(struct replay_buffer *buf)
+{
+	if (buf->registered)
+		return gralloc_drm_bo_from_handle(buf->clone);
+
+	return buf->bo;
+}
+
+static int replay_alloc(struct replay *rp, const struct gralloc_drm_record *rec)
+{
+	struct replay_buffer *buf;
+	struct gralloc_drm_bo_t *bo;
+
+	bo = gralloc_drm_bo_create(rp->drm, rec->width, rec->height,
+			rec->format, rec->usage);
+	if (!bo)
+		return -ENOMEM;
+
+	/* a stale entry of a reused id */
+	buf = replay_find(rp, rec->buffer);
+	if (!buf) {
+		buf = replay_add(rp, rec->buffer);
+		if (!buf) {
+			gralloc_drm_bo_decref(bo);
+			return -ENOMEM;
+		}
+	}
+	else if (buf->bo) {
+		gralloc_drm_bo_decref(buf->bo);
+	}
+
+	buf->bo = bo;
+	buf->owned = 1;
+
+	return 0;
+}
+
+static int replay_free(struct replay *rp, struct replay_buffer *buf)
+{
+	if (!buf->bo || !buf->owned)
+		return -EINVAL;
+
+	gralloc_drm_bo_decref(buf->bo);
+	buf->bo = NULL;
+	replay_put(rp, buf);
+
+	return 0;
+}
+
+static int replay_register(struct replay *rp, const struct gralloc_drm_record *rec,
+		struct replay_buffer *buf)
+{
+	int stride, err;
+
+	/* imported from another process: create it here */
+	if (!buf->bo) {
+		buf->bo = gralloc_drm_bo_create(rp->drm, rec->width,
+				rec->height, rec->format, rec->usage);
+		if (!buf->bo) {
+			replay_put(rp, buf);
+			return -ENOMEM;
+		}
+		buf->owned = 0;
+	}
+
+	if (buf->registered)
+		return 0;
+
+	if (!buf->clone) {
+		buf->clone = bench_clone_handle(
+				gralloc_drm_bo_get_handle(buf->bo, &stride));
+	}
+
+	err = (buf->clone) ?
+		gralloc_drm_handle_register(buf->clone, rp->drm) : -ENOMEM;
+	if (!err) {
+		buf->registered = 1;
+	}
+	else if (!buf->owned) {
+		gralloc_drm_bo_decref(buf->bo);
+		buf->bo = NULL;
+		replay_put(rp, buf);
+	}
+
+	return err;
+}
+
+static int replay_unregister(struct replay *rp, struct replay_buffer *buf)
+{
+	int err;
+
+	if (!buf->registered)
+		return -EINVAL;
+
+	err = gralloc_drm_handle_unregister(buf->clone);
+	buf->registered = 0;
+
+	if (buf->bo && !buf->owned) {
+		gralloc_drm_bo_decref(buf->bo);
+		buf->bo = NULL;
+	}
+	replay_put(rp, buf);
+
+	return err;
+}
+
+static int replay_lock(struct replay_buffer *buf,
+		const struct gralloc_drm_record *rec)
+{
+	struct gralloc_drm_bo_t *bo = replay_get_bo(buf);
+	int err;
+
+	if (!bo)
+		return -EINVAL;
+
+	if (rec->op == GRALLOC_DRM_RECORD_LOCK_YCBCR) {
+		struct android_ycbcr ycbcr;
+
+		err = gralloc_drm_bo_lock_ycbcr(bo, rec->usage, rec->x, rec->y,
+				rec->w, rec->h, &ycbcr);
+	}
+	else {
+		void *ptr;
+
+		err = gralloc_drm_bo_lock(bo, rec->usage, rec->x, rec->y,
+				rec->w, rec->h, &ptr);
+	}
+
+	if (!err)
+		buf->locked = bo;
+
+	return err;
+}
+
+static int replay_unlock(struct replay_buffer *buf)
+{
+	if (!buf->locked)
+		return -EINVAL;
+
+	gralloc_drm_bo_unlock(buf->locked);
+	buf->locked = NULL;
+
+	return 0;
+}
+
+/*
+ * Replay a record.  Return 1 when there is nothing to replay.
+ */
+static int replay_one(struct replay *rp, const struct gralloc_drm_record *rec)
+{
+	struct replay_buffer *buf;
+
+	if (rec->op == GRALLOC_DRM_RECORD_ALLOC)
+		return replay_alloc(rp, rec);
+
+	buf = replay_find(rp, rec->buffer);
+	if (!buf) {
+		/* the first sight of a buffer the process imported */
+		if (rec->op != GRALLOC_DRM_RECORD_REGISTER) {
+			rp->unknown++;
+			return 1;
+		}
+
+		buf = replay_add(rp, rec->buffer);
+		if (!buf)
+			return -ENOMEM;
+	}
+
+	switch (rec->op) {
+	case GRALLOC_DRM_RECORD_FREE:
+		return replay_free(rp, buf);
+	case GRALLOC_DRM_RECORD_REGISTER:
+		return replay_register(rp, rec, buf);
+	case GRALLOC_DRM_RECORD_UNREGISTER:
+		return replay_unregister(rp, buf);
+	case GRALLOC_DRM_RECORD_LOCK:
+	case GRALLOC_DRM_RECORD_LOCK_YCBCR:
+		return replay_lock(buf, rec);
+	case GRALLOC_DRM_RECORD_UNLOCK:
+		return replay_unlock(buf);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Sleep until the time of a record, relative to the start of the replay.
+ */
+static void replay_wait(int64_t start, int64_t time)
+{
+	int64_t delay = start + time - gralloc_drm_get_time();
+	struct timespec ts;
+
+	if (delay <= 0)
+		return;
+
+	ts.tv_sec = delay / 1000000000;
+	ts.tv_nsec = delay % 1000000000;
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static int replay_file(struct replay *rp, FILE *trace, int realtime)
+{
+	struct gralloc_drm_record_header header;
+	struct gralloc_drm_record rec;
+	int64_t start, t;
+	int err;
+
+	if (fread(&header, sizeof(header), 1, trace) != 1 ||
+	    header.magic != GRALLOC_DRM_RECORD_MAGIC) {
+		fprintf(stderr, "not a gralloc_drm trace\n");
+		return -EINVAL;
+	}
+
+	if (header.version != GRALLOC_DRM_RECORD_VERSION ||
+	    header.record_size != sizeof(rec)) {
+		fprintf(stderr, "unsupported trace version %u\n",
+				header.version);
+		return -EINVAL;
+	}
+
+	start = gralloc_drm_get_time();
+	while (fread(&rec, sizeof(rec), 1, trace) == 1) {
+		if (rec.op <= 0 || rec.op >= OP_COUNT) {
+			fprintf(stderr, "bad record %d\n", rp->records);
+			return -EINVAL;
+		}
+		rp->records++;
+
+		/* there is nothing to reproduce of a failed call */
+		if (rec.err) {
+			rp->skipped++;
+			continue;
+		}
+
+		if (realtime)
+			replay_wait(start, rec.time);
+
+		t = gralloc_drm_get_time();
+		err = replay_one(rp, &rec);
+		t = gralloc_drm_get_time() - t;
+
+		if (err) {
+			if (err < 0)
+				rp->failed++;
+			continue;
+		}
+
+		bench_samples_add(&rp->recorded[rec.op], rec.duration);
+		bench_samples_add(&rp->replayed[rec.op], t);
+	}
+
+	return 0;
+}
+
+/*
+ * Release what the trace left allocated or imported.
+ */
+static void replay_cleanup(struct replay *rp)
+{
+	while (rp->count) {
+		struct replay_buffer *buf = &rp->buffers[rp->count - 1];
+
+		if (buf->locked)
+			replay_unlock(buf);
+		if (buf->registered)
+			replay_unregister(rp, buf);
+		if (buf->bo && buf->owned)
+			replay_free(rp, buf);
+	}
+
+	free(rp->buffers);
+}
+
+static void usage_exit(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b drm|soft] [-r] [-o file] trace\n",
+			prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *backend = "drm";
+	struct replay rp;
+	FILE *fp = stdout, *trace;
+	int realtime = 0, leaked, max;
+	int op, opt, err, first = 1;
+
+	while ((opt = getopt(argc, argv, "b:ro:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'r':
+			realtime = 1;
+			break;
+		case 'o':
+			fp = fopen(optarg, "w");
+			if (!fp) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage_exit(argv[0]);
+			break;
+		}
+	}
+
+	if (optind != argc - 1)
+		usage_exit(argv[0]);
+
+	trace = fopen(argv[optind], "rb");
+	if (!trace) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	/* room for a sample of every record */
+	fseek(trace, 0, SEEK_END);
+	max = ftell(trace) / sizeof(struct gralloc_drm_record) + 1;
+	rewind(trace);
+
+	memset(&rp, 0, sizeof(rp));
+	rp.drm = bench_create_drm(backend);
+	if (!rp.drm) {
+		fprintf(stderr, "failed to create the %s backend\n", backend);
+		return 1;
+	}
+
+	for (op = 1; op < OP_COUNT; op++) {
+		if (bench_samples_init(&rp.recorded[op], max) ||
+		    bench_samples_init(&rp.replayed[op], max))
+			return 1;
+	}
+
+	err = replay_file(&rp, trace, realtime);
+	fclose(trace);
+
+	leaked = rp.count;
+	replay_cleanup(&rp);
+
+	fprintf(fp, "{\n\"benchmark\": \"gralloc_drm_replay\",\n"
+			"\"backend\": \"%s\",\n\"realtime\": %s,\n"
+			"\"records\": %d,\n\"skipped\": %d,\n"
+			"\"failed\": %d,\n\"unknown\": %d,\n"
+			"\"peak_buffers\": %d,\n\"leaked_buffers\": %d,\n"
+			"\"results\": [\n", backend,
+			(realtime) ? "true" : "false", rp.records,
+			rp.skipped, rp.failed, rp.unknown, rp.peak_live,
+			leaked);
+
+	for (op = 1; op < OP_COUNT; op++) {
+		struct bench_stats stats;
+
+		if (!rp.replayed[op].count)
+			continue;
+
+		fprintf(fp, "%s{\"op\": \"%s\", ", (first) ? "" : ",\n",
+				op_names[op]);
+		first = 0;
+
+		bench_samples_get_stats(&rp.recorded[op], &stats);
+		bench_json_stats(fp, "recorded", &stats);
+		fprintf(fp, ", ");
+		bench_samples_get_stats(&rp.replayed[op], &stats);
+		bench_json_stats(fp, "replayed", &stats);
+		fprintf(fp, "}");
+	}
+
+	fprintf(fp, "\n]\n}\n");
+
+	for (op = 1; op < OP_COUNT; op++) {
+		bench_samples_fini(&rp.recorded[op]);
+		bench_samples_fini(&rp.replayed[op]);
+	}
+	gralloc_drm_destroy(rp.drm);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	return (err) ? 1 : 0;
+}
@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Stress check of the handle registration and the bo refcounting.  Many
+ * threads register, lock and unregister copies of the same buffers, as
+ * binder threads of different clients would, while others take and drop
+ * references of the originals, stack locks on bos of their own and churn
+ * new bos through the cache.  It runs on the software driver, whose free
+ * is wrapped so that:
+ *
+ *  - a bo freed while referenced or locked, or freed twice, fails;
+ *  - a freed bo is poisoned and kept, and a write to it fails;
+ *  - a bo still alive after gralloc_drm_destroy is a leak and fails.
+ *
+ *   gralloc_drm_stress [-t threads] [-n iterations] [-s seed]
+ *
+ * The exit status is 0 when no check failed.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <hardware/gralloc.h>
+
+#include "bench.h"
+
+#define STRESS_BUFFERS 8
+#define STRESS_WIDTH 256
+#define STRESS_HEIGHT 64
+#define STRESS_REGION 64 /* bytes written by a thread, at its own offset */
+#define STRESS_POISON 0x6b
+
+struct stress_thread {
+	pthread_t thread;
+	int index;
+	unsigned int seed;
+};
+
+static struct gralloc_drm_t *stress_drm;
+static struct gralloc_drm_bo_t *stress_bos[STRESS_BUFFERS];
+/* registered once by the main thread and looked up by the workers */
+static buffer_handle_t stress_shared[STRESS_BUFFERS];
+static int stress_iterations = 20000;
+static int stress_failures;
+
+/* the bos of the driver, see stress_alloc and stress_free */
+static pthread_mutex_t stress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct gralloc_drm_bo_t **stress_live;
+static int stress_live_count, stress_live_size;
+static struct gralloc_drm_bo_t **stress_freed;
+static int stress_freed_count, stress_freed_size;
+
+static struct gralloc_drm_bo_t *(*soft_alloc)(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle);
+
+static void __attribute__((format(printf, 1, 2)))
+stress_fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+
+	__atomic_add_fetch(&stress_failures, 1, __ATOMIC_RELAXED);
+}
+
+static int stress_append(struct gralloc_drm_bo_t ***array, int *count,
+		int *size, struct gralloc_drm_bo_t *bo)
+{
+	if (*count >= *size) {
+		int new_size = (*size) ? *size * 2 : 256;
+		struct gralloc_drm_bo_t **tmp;
+
+		tmp = realloc(*array, sizeof(*tmp) * new_size);
+		if (!tmp)
+			return -ENOMEM;
+
+		*array = tmp;
+		*size = new_size;
+	}
+
+	(*array)[(*count)++] = bo;
+
+	return 0;
+}
+
+static struct gralloc_drm_bo_t *stress_alloc(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct gralloc_drm_bo_t *bo = soft_alloc(drv, handle);
+
+	if (bo) {
+		pthread_mutex_lock(&stress_mutex);
+		if (stress_append(&stress_live, &stress_live_count,
+					&stress_live_size, bo))
+			stress_fail("out of memory");
+		pthread_mutex_unlock(&stress_mutex);
+	}
+
+	return bo;
+}
+
+/*
+ * Free a bo of the software driver, keeping its memory poisoned instead
+ * of releasing it.
+ */
+static void stress_free(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	int refcount = __atomic_load_n(&bo->refcount, __ATOMIC_ACQUIRE);
+	int32_t lock_state = __atomic_load_n(&bo->lock_state, __ATOMIC_ACQUIRE);
+	int i;
+
+	if (refcount)
+		stress_fail("bo %p freed with %d references", bo, refcount);
+	if (lock_state)
+		stress_fail("bo %p freed locked (0x%x)", bo, lock_state);
+
+	pthread_mutex_lock(&stress_mutex);
+
+	for (i = 0; i < stress_live_count; i++) {
+		if (stress_live[i] == bo)
+			break;
+	}
+
+	if (i < stress_live_count) {
+		stress_live[i] = stress_live[--stress_live_count];
+
+		/* as soft_free does */
+		if (!bo->imported && bo->handle->prime_fd >= 0) {
+			close(bo->handle->prime_fd);
+			bo->handle->prime_fd = -1;
+		}
+
+		memset(bo, STRESS_POISON, sizeof(*bo));
+		if (stress_append(&stress_freed, &stress_freed_count,
+					&stress_freed_size, bo))
+			free(bo);
+	}
+	else {
+		stress_fail("bo %p freed but not alive", bo);
+	}
+
+	pthread_mutex_unlock(&stress_mutex);
+}
+
+static struct gralloc_drm_t *stress_create_drm(void)
+{
+	struct gralloc_drm_drv_t *drv;
+
+	drv = bench_create_soft_drv();
+	if (!drv)
+		return NULL;
+
+	soft_alloc = drv->alloc;
+	drv->alloc = stress_alloc;
+	drv->free = stress_free;
+
+	return gralloc_drm_create_for_drv(drv);
+}
+
+/*
+ * Register a copy of a buffer as another process would, write this
+ * thread's region through it, read it back, and unregister it.
+ */
+static void stress_import(struct stress_thread *t, int i)
+{
+	buffer_handle_t clone;
+	struct gralloc_drm_bo_t *bo;
+	uint8_t *ptr, value = (uint8_t) (t->index + 1);
+	void *addr;
+	int j;
+
+	clone = bench_clone_handle(gralloc_drm_bo_get_handle(stress_bos[i],
+				NULL));
+	if (!clone) {
+		stress_fail("failed to clone handle");
+		return;
+	}
+
+	if (gralloc_drm_handle_register(clone, stress_drm)) {
+		stress_fail("failed to register a copy of buffer %d", i);
+		bench_free_clone(clone);
+		return;
+	}
+
+	bo = gralloc_drm_bo_from_handle(clone);
+	if (!bo) {
+		stress_fail("registered copy of buffer %d not published", i);
+		goto out;
+	}
+
+	if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0,
+				STRESS_WIDTH, STRESS_HEIGHT, &addr)) {
+		stress_fail("failed to lock a copy of buffer %d", i);
+		goto out;
+	}
+	ptr = (uint8_t *) addr + t->index * STRESS_REGION;
+	memset(ptr, value, STRESS_REGION);
+	gralloc_drm_bo_unlock(bo);
+
+	if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0,
+				STRESS_WIDTH, STRESS_HEIGHT, &addr)) {
+		stress_fail("failed to relock a copy of buffer %d", i);
+		goto out;
+	}
+	ptr = (uint8_t *) addr + t->index * STRESS_REGION;
+	for (j = 0; j < STRESS_REGION; j++) {
+		if (ptr[j] != value) {
+			stress_fail("thread %d read 0x%x instead of 0x%x "
+					"in buffer %d", t->index, ptr[j],
+					value, i);
+			break;
+		}
+	}
+	gralloc_drm_bo_unlock(bo);
+
+out:
+	if (gralloc_drm_handle_unregister(clone))
+		stress_fail("failed to unregister a copy of buffer %d", i);
+	else if (((struct gralloc_drm_handle_t *) clone)->data)
+		stress_fail("unregistered copy of buffer %d still published", i);
+
+	bench_free_clone(clone);
+}
+
+/*
+ * Take a reference of an original by registering its handle locally, and
+ * read-lock it through the shared copy.
+ */
+static void stress_reference(struct stress_thread *t, int i)
+{
+	buffer_handle_t handle = gralloc_drm_bo_get_handle(stress_bos[i], NULL);
+	struct gralloc_drm_bo_t *bo;
+	void *addr;
+
+	if (gralloc_drm_handle_register(handle, stress_drm)) {
+		stress_fail("failed to register buffer %d", i);
+		return;
+	}
+
+	bo = gralloc_drm_bo_from_handle(stress_shared[i]);
+	if (!bo) {
+		stress_fail("shared copy of buffer %d not published", i);
+	}
+	else if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0,
+				STRESS_WIDTH, STRESS_HEIGHT, &addr)) {
+		stress_fail("failed to lock the shared copy of buffer %d", i);
+	}
+	else {
+		gralloc_drm_bo_unlock(bo);
+	}
+
+	if (gralloc_drm_handle_unregister(handle))
+		stress_fail("failed to unregister buffer %d", i);
+}
+
+/*
+ * Take the locks a producer stacks on its own buffer: a render lock, a
+ * write lock on top of it, and a second write lock from the same client.
+ * None of them conflicts, and both writers must get the same mapping.
+ */
+static void stress_relock(struct stress_thread *t, int i)
+{
+	struct gralloc_drm_bo_t *bo;
+	void *addr, *again;
+	int locked = 0;
+
+	bo = gralloc_drm_bo_create(stress_drm, STRESS_WIDTH - 8 * i,
+			STRESS_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888,
+			GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_SW_WRITE_OFTEN);
+	if (!bo) {
+		stress_fail("failed to allocate a bo");
+		return;
+	}
+
+	if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_HW_RENDER, 0, 0,
+				STRESS_WIDTH - 8 * i, STRESS_HEIGHT, &addr)) {
+		stress_fail("failed to render-lock a bo");
+		goto out;
+	}
+	locked++;
+
+	if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0,
+				STRESS_WIDTH - 8 * i, STRESS_HEIGHT, &addr)) {
+		stress_fail("failed to write-lock a render-locked bo");
+		goto out;
+	}
+	locked++;
+
+	if (gralloc_drm_bo_lock(bo, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0,
+				STRESS_WIDTH - 8 * i, STRESS_HEIGHT, &again)) {
+		stress_fail("failed to write-lock a bo twice");
+		goto out;
+	}
+	locked++;
+
+	if (again != addr)
+		stress_fail("second write lock mapped %p instead of %p",
+				again, addr);
+	memset(addr, t->index + 1, STRESS_REGION);
+
+out:
+	while (locked--)
+		gralloc_drm_bo_unlock(bo);
+	gralloc_drm_bo_decref(bo);
+}
+
+/* allocate and free a bo, which goes through the cache */
+static void stress_churn(struct stress_thread *t, int i)
+{
+	struct gralloc_drm_bo_t *bo;
+	buffer_handle_t clone;
+
+	bo = gralloc_drm_bo_create(stress_drm, STRESS_WIDTH - 8 * i,
+			STRESS_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888,
+			GRALLOC_USAGE_HW_TEXTURE);
+	if (!bo) {
+		stress_fail("failed to allocate a bo");
+		return;
+	}
+
+	/* some are also sent and released by the receiver first */
+	if (rand_r(&t->seed) & 1) {
+		clone = bench_clone_handle(gralloc_drm_bo_get_handle(bo, NULL));
+		if (clone && !gralloc_drm_handle_register(clone, stress_drm))
+			gralloc_drm_handle_unregister(clone);
+		if (clone)
+			bench_free_clone(clone);
+	}
+
+	gralloc_drm_bo_decref(bo);
+}
+
+static void *stress_thread_main(void *data)
+{
+	struct stress_thread *t = (struct stress_thread *) data;
+	int n;
+
+	for (n = 0; n < stress_iterations; n++) {
+		int i = rand_r(&t->seed) % STRESS_BUFFERS;
+
+		switch (rand_r(&t->seed) % 4) {
+		case 0:
+			stress_import(t, i);
+			break;
+		case 1:
+			stress_reference(t, i);
+			break;
+		case 2:
+			stress_relock(t, i);
+			break;
+		default:
+			stress_churn(t, i);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* check that no freed bo has been written since it was poisoned */
+static void stress_check_freed(void)
+{
+	int i, j;
+
+	for (i = 0; i < stress_freed_count; i++) {
+		const uint8_t *p = (const uint8_t *) stress_freed[i];
+
+		for (j = 0; j < (int) sizeof(struct gralloc_drm_bo_t); j++) {
+			if (p[j] != STRESS_POISON) {
+				stress_fail("bo %p written at offset %d after "
+						"it was freed", p, j);
+				break;
+			}
+		}
+
+		free(stress_freed[i]);
+	}
+
+	free(stress_freed);
+	stress_freed = NULL;
+	stress_freed_count = 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct stress_thread *threads;
+	unsigned int seed = 1;
+	int thread_count = 8;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			thread_count = atoi(optarg);
+			break;
+		case 'n':
+			stress_iterations = atoi(optarg);
+			break;
+		case 's':
+			seed = (unsigned int) strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] "
+					"[-n iterations] [-s seed]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	/* the regions of the threads must fit in a buffer */
+	if (thread_count < 1 ||
+	    thread_count * STRESS_REGION > STRESS_WIDTH * 4 * STRESS_HEIGHT) {
+		fprintf(stderr, "bad thread count %d\n", thread_count);
+		return 2;
+	}
+
+	threads = calloc(thread_count, sizeof(*threads));
+	stress_drm = stress_create_drm();
+	if (!threads || !stress_drm) {
+		fprintf(stderr, "failed to set up\n");
+		return 1;
+	}
+
+	for (i = 0; i < STRESS_BUFFERS; i++) {
+		stress_bos[i] = gralloc_drm_bo_create(stress_drm,
+				STRESS_WIDTH, STRESS_HEIGHT,
+				HAL_PIXEL_FORMAT_RGBA_8888,
+				GRALLOC_USAGE_HW_TEXTURE |
+				GRALLOC_USAGE_SW_READ_OFTEN |
+				GRALLOC_USAGE_SW_WRITE_OFTEN);
+		if (!stress_bos[i]) {
+			fprintf(stderr, "failed to allocate buffer %d\n", i);
+			return 1;
+		}
+
+		stress_shared[i] = bench_clone_handle(
+				gralloc_drm_bo_get_handle(stress_bos[i], NULL));
+		if (!stress_shared[i] ||
+		    gralloc_drm_handle_register(stress_shared[i], stress_drm)) {
+			fprintf(stderr, "failed to share buffer %d\n", i);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < thread_count; i++) {
+		threads[i].index = i;
+		threads[i].seed = seed + i;
+		if (pthread_create(&threads[i].thread, NULL,
+					stress_thread_main, &threads[i])) {
+			fprintf(stderr, "failed to create thread %d\n", i);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	for (i = 0; i < STRESS_BUFFERS; i++) {
+		if (gralloc_drm_handle_unregister(stress_shared[i]))
+			stress_fail("failed to unregister shared buffer %d", i);
+		bench_free_clone(stress_shared[i]);
+		gralloc_drm_bo_decref(stress_bos[i]);
+	}
+
+	gralloc_drm_destroy(stress_drm);
+
+	if (stress_live_count)
+		stress_fail("%d bos leaked", stress_live_count);
+	stress_check_freed();
+
+	printf("%d threads x %d iterations: %d failures\n", thread_count,
+			stress_iterations, stress_failures);
+
+	free(threads);
+
+	return (stress_failures) ? 1 : 0;
+}
@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Synthetic workloads on the gralloc_drm core, shaped like the pipelines
+ * that use it: a triple buffered compositor at 60 and 120 Hz, a camera ZSL
+ * ring, codec output pools that are reallocated on seeks, and the texture
+ * bursts of app launches.  Each workload runs for a number of frames and
+ * reports the time gralloc takes out of every frame, the peak memory and
+ * the allocations that stalled, as JSON.
+ *
+ *   gralloc_drm_workload [-b drm|soft] [-w workload] [-f frames]
+ *                        [-s stall_us] [-r] [-o file]
+ *
+ * With -r, frames are paced at the rate of the workload so that work
+ * deferred to idle time, like the zero-fill of cached bos, happens as it
+ * would on a device.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define MAX_BUFFERS 64
+
+struct workload;
+
+struct context {
+	struct gralloc_drm_t *drm;
+	int frames;
+	int realtime;
+	int64_t stall_ns;
+
+	/* time gralloc took in the current frame */
+	int64_t frame_ns;
+	int64_t frame_budget;
+	int64_t next_frame;
+
+	struct bench_samples frame_samples;
+	struct bench_samples alloc_samples;
+	int missed_frames;
+	int stalls;
+	int failures;
+
+	size_t live_bytes, peak_live_bytes;
+	size_t peak_cached_bytes;
+};
+
+/* a buffer and its import by the consumer */
+struct buffer {
+	struct gralloc_drm_bo_t *bo;
+	buffer_handle_t clone;
+	size_t size;
+};
+
+struct workload {
+	const char *name;
+	void (*frame)(struct context *ctx, const struct workload *wl,
+		      struct buffer *buffers, int frame);
+
+	int width, height;
+	int format;
+	int usage;
+	int buffers;
+	int rate;   /* frames per second */
+	int period; /* frames between reallocations, captures or launches */
+};
+
+static size_t buffer_get_size(buffer_handle_t handle)
+{
+	struct gralloc_drm_handle_t *h = gralloc_drm_handle(handle);
+	off_t size = -1;
+
+	if (h->prime_fd >= 0)
+		size = lseek(h->prime_fd, 0, SEEK_END);
+
+	/* drivers without prime fds */
+	if (size <= 0)
+		size = (off_t) h->stride * h->height;
+
+	return size;
+}
+
+static void context_update_peak(struct context *ctx)
+{
+	size_t cached;
+
+	if (ctx->peak_live_bytes < ctx->live_bytes)
+		ctx->peak_live_bytes = ctx->live_bytes;
+
+	gralloc_drm_mutex_lock(&ctx->drm->cache_mutex);
+	cached = ctx->drm->cache_bytes;
+	gralloc_drm_mutex_unlock(&ctx->drm->cache_mutex);
+
+	if (ctx->peak_cached_bytes < cached)
+		ctx->peak_cached_bytes = cached;
+}
+
+/*
+ * Allocate a buffer and import it as the consumer would.  The time of both
+ * counts as one allocation.
+ */
+static int buffer_alloc(struct context *ctx, struct buffer *buf, int width,
+		int height, int format, int usage)
+{
+	buffer_handle_t handle = NULL;
+	int64_t t;
+	int stride;
+
+	memset(buf, 0, sizeof(*buf));
+
+	t = gralloc_drm_get_time();
+	buf->bo = gralloc_drm_bo_create(ctx->drm, width, height, format,
+			usage);
+	if (buf->bo) {
+		handle = gralloc_drm_bo_get_handle(buf->bo, &stride);
+		buf->clone = bench_clone_handle(handle);
+		if (buf->clone &&
+		    gralloc_drm_handle_register(buf->clone, ctx->drm)) {
+			bench_free_clone(buf->clone);
+			buf->clone = NULL;
+		}
+	}
+	t = gralloc_drm_get_time() - t;
+
+	ctx->frame_ns += t;
+	bench_samples_add(&ctx->alloc_samples, t);
+	if (t > ctx->stall_ns)
+		ctx->stalls++;
+
+	if (!buf->bo) {
+		ctx->failures++;
+		return -ENOMEM;
+	}
+
+	buf->size = buffer_get_size(handle);
+	ctx->live_bytes += buf->size;
+	context_update_peak(ctx);
+
+	return 0;
+}
+
+static void buffer_free(struct context *ctx, struct buffer *buf)
+{
+	int64_t t;
+
+	if (!buf->bo)
+		return;
+
+	t = gralloc_drm_get_time();
+	if (buf->clone)
+		gralloc_drm_handle_unregister(buf->clone);
+	gralloc_drm_bo_decref(buf->bo);
+	ctx->frame_ns += gralloc_drm_get_time() - t;
+
+	if (buf->clone)
+		bench_free_clone(buf->clone);
+
+	ctx->live_bytes -= buf->size;
+	memset(buf, 0, sizeof(*buf));
+
+	context_update_peak(ctx);
+}
+
+/*
+ * Lock a buffer for the CPU and touch its first line, as a producer
+ * filling it or a consumer reading it would.  Only the lock and the unlock
+ * are timed.
+ */
+static void buffer_access(struct context *ctx, struct buffer *buf,
+		int usage)
+{
+	struct gralloc_drm_handle_t *handle = buf->bo->handle;
+	volatile unsigned char *line;
+	int64_t t;
+	int err;
+
+	t = gralloc_drm_get_time();
+	if (bench_format_is_ycbcr(handle->format)) {
+		struct android_ycbcr ycbcr;
+
+		err = gralloc_drm_bo_lock_ycbcr(buf->bo, usage, 0, 0,
+				handle->width, handle->height, &ycbcr);
+		line = ycbcr.y;
+	}
+	else {
+		void *ptr;
+
+		err = gralloc_drm_bo_lock(buf->bo, usage, 0, 0,
+				handle->width, handle->height, &ptr);
+		line = ptr;
+	}
+	ctx->frame_ns += gralloc_drm_get_time() - t;
+
+	if (err) {
+		ctx->failures++;
+		return;
+	}
+
+	if (usage & GRALLOC_USAGE_SW_WRITE_MASK)
+		memset((void *) line, 0x80, handle->stride);
+	else
+		(void) line[handle->stride - 1];
+
+	t = gralloc_drm_get_time();
+	gralloc_drm_bo_unlock(buf->bo);
+	ctx->frame_ns += gralloc_drm_get_time() - t;
+}
+
+static void buffer_alloc_set(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers, int width, int height)
+{
+	int i;
+
+	for (i = 0; i < wl->buffers; i++)
+		buffer_alloc(ctx, &buffers[i], width, height, wl->format,
+				wl->usage);
+}
+
+static void buffer_free_set(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers)
+{
+	int i;
+
+	for (i = 0; i < wl->buffers; i++)
+		buffer_free(ctx, &buffers[i]);
+}
+
+/*
+ * A client renders into the next buffer of its swap chain, which the
+ * compositor has imported.  Every period the display rotates and the swap
+ * chain is reallocated.
+ */
+static void compositor_frame(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers, int frame)
+{
+	struct buffer *buf;
+	int rotated;
+
+	if (frame % wl->period == 0) {
+		rotated = (frame / wl->period) & 1;
+
+		buffer_free_set(ctx, wl, buffers);
+		buffer_alloc_set(ctx, wl, buffers,
+				(rotated) ? wl->height : wl->width,
+				(rotated) ? wl->width : wl->height);
+	}
+
+	buf = &buffers[frame % wl->buffers];
+	if (buf->bo)
+		buffer_access(ctx, buf, GRALLOC_USAGE_SW_WRITE_OFTEN);
+}
+
+/*
+ * The sensor fills a ring of buffers at the frame rate.  Every period a
+ * capture reads back the oldest one, and every ten captures the session is
+ * reconfigured and the ring reallocated.
+ */
+static void camera_frame(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers, int frame)
+{
+	struct buffer *buf;
+
+	if (frame % (wl->period * 10) == 0) {
+		buffer_free_set(ctx, wl, buffers);
+		buffer_alloc_set(ctx, wl, buffers, wl->width, wl->height);
+	}
+
+	buf = &buffers[frame % wl->buffers];
+	if (buf->bo)
+		buffer_access(ctx, buf, GRALLOC_USAGE_SW_WRITE_OFTEN);
+
+	if (frame % wl->period == wl->period - 1) {
+		buf = &buffers[(frame + 1) % wl->buffers];
+		if (buf->bo)
+			buffer_access(ctx, buf, GRALLOC_USAGE_SW_READ_OFTEN);
+	}
+}
+
+/*
+ * A decoder writes every frame into its output pool.  Every period a seek
+ * reconfigures the output port, and the pool is freed and reallocated.
+ */
+static void codec_frame(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers, int frame)
+{
+	struct buffer *buf;
+
+	if (frame % wl->period == 0) {
+		buffer_free_set(ctx, wl, buffers);
+		buffer_alloc_set(ctx, wl, buffers, wl->width, wl->height);
+	}
+
+	buf = &buffers[frame % wl->buffers];
+	if (buf->bo)
+		buffer_access(ctx, buf, GRALLOC_USAGE_SW_WRITE_OFTEN);
+}
+
+/*
+ * Every period an app launches: the textures of the previous one are freed
+ * and a burst of icons, atlases and window-sized textures is allocated and
+ * uploaded within a single frame.
+ */
+static void launch_frame(struct context *ctx, const struct workload *wl,
+		struct buffer *buffers, int frame)
+{
+	static const struct {
+		int width, height;
+	} sizes[] = {
+		{ 96, 96 },
+		{ 192, 192 },
+		{ 512, 512 },
+		{ 1024, 1024 },
+		{ 1080, 1920 },
+	};
+	int i;
+
+	if (frame % wl->period)
+		return;
+
+	buffer_free_set(ctx, wl, buffers);
+
+	for (i = 0; i < wl->buffers; i++) {
+		int s = (i + frame / wl->period) % ARRAY_SIZE(sizes);
+
+		if (buffer_alloc(ctx, &buffers[i], sizes[s].width,
+				 sizes[s].height, wl->format, wl->usage))
+			continue;
+		buffer_access(ctx, &buffers[i], GRALLOC_USAGE_SW_WRITE_OFTEN);
+	}
+}
+
+static const struct workload workloads[] = {
+	{ "compositor_60hz", compositor_frame, 1920, 1080,
+	  HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+	  GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  3, 60, 300 },
+	{ "compositor_120hz", compositor_frame, 1920, 1080,
+	  HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+	  GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  3, 120, 600 },
+	{ "camera_zsl", camera_frame, 1920, 1440,
+	  HAL_PIXEL_FORMAT_YCbCr_420_888,
+	  GRALLOC_USAGE_HW_CAMERA_ZSL | GRALLOC_USAGE_SW_READ_OFTEN |
+	  GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  8, 30, 45 },
+	{ "codec_yv12", codec_frame, 1920, 1080,
+	  HAL_PIXEL_FORMAT_YV12,
+	  GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  12, 60, 240 },
+	{ "codec_420_888", codec_frame, 1920, 1080,
+	  HAL_PIXEL_FORMAT_YCbCr_420_888,
+	  GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  12, 60, 240 },
+	{ "app_launch", launch_frame, 0, 0,
+	  HAL_PIXEL_FORMAT_RGBA_8888,
+	  GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_WRITE_OFTEN,
+	  40, 60, 60 },
+};
+
+/*
+ * Wait for the next frame when paced.
+ */
+static void context_wait_frame(struct context *ctx)
+{
+	int64_t delay;
+	struct timespec ts;
+
+	ctx->next_frame += ctx->frame_budget;
+	delay = ctx->next_frame - gralloc_drm_get_time();
+	if (delay <= 0)
+		return;
+
+	ts.tv_sec = delay / 1000000000;
+	ts.tv_nsec = delay % 1000000000;
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static void run_workload(struct context *ctx, const struct workload *wl,
+		FILE *fp)
+{
+	struct buffer buffers[MAX_BUFFERS];
+	struct bench_stats stats;
+	int frame;
+
+	memset(buffers, 0, sizeof(buffers));
+	bench_samples_reset(&ctx->frame_samples);
+	bench_samples_reset(&ctx->alloc_samples);
+	ctx->missed_frames = 0;
+	ctx->stalls = 0;
+	ctx->failures = 0;
+	ctx->live_bytes = 0;
+	ctx->peak_live_bytes = 0;
+	ctx->peak_cached_bytes = 0;
+	ctx->frame_budget = 1000000000 / wl->rate;
+	ctx->next_frame = gralloc_drm_get_time();
+
+	for (frame = 0; frame < ctx->frames; frame++) {
+		ctx->frame_ns = 0;
+		wl->frame(ctx, wl, buffers, frame);
+
+		bench_samples_add(&ctx->frame_samples, ctx->frame_ns);
+		if (ctx->frame_ns > ctx->frame_budget)
+			ctx->missed_frames++;
+
+		if (ctx->realtime)
+			context_wait_frame(ctx);
+	}
+
+	buffer_free_set(ctx, wl, buffers);
+
+	bench_samples_get_stats(&ctx->frame_samples, &stats);
+	fprintf(fp, "{\"workload\": \"%s\", \"format\": \"%s\", "
+			"\"buffers\": %d, \"rate\": %d, \"frames\": %d, "
+			"\"frame_budget_ns\": %lld, ",
+			wl->name, bench_format_name(wl->format), wl->buffers,
+			wl->rate, ctx->frames, (long long) ctx->frame_budget);
+	bench_json_stats(fp, "gralloc_per_frame", &stats);
+	fprintf(fp, ", \"p99_budget_pct\": %.2f, \"max_budget_pct\": %.2f, "
+			"\"missed_frames\": %d, ",
+			stats.p99 * 100.0 / ctx->frame_budget,
+			stats.max * 100.0 / ctx->frame_budget,
+			ctx->missed_frames);
+
+	bench_samples_get_stats(&ctx->alloc_samples, &stats);
+	bench_json_stats(fp, "alloc", &stats);
+	fprintf(fp, ", \"stalls\": %d, \"failures\": %d, "
+			"\"peak_live_bytes\": %zu, "
+			"\"peak_cached_bytes\": %zu}",
+			ctx->stalls, ctx->failures, ctx->peak_live_bytes,
+			ctx->peak_cached_bytes);
+}
+
+static void usage_exit(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr, "usage: %s [-b drm|soft] [-w workload] [-f frames] "
+			"[-s stall_us] [-r] [-o file]\nworkloads:", prog);
+	for (i = 0; i < ARRAY_SIZE(workloads); i++)
+		fprintf(stderr, " %s", workloads[i].name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *backend = "drm", *name = NULL;
+	struct context ctx;
+	FILE *fp = stdout;
+	unsigned int i;
+	int opt, first = 1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.frames = 600;
+	ctx.stall_ns = 1000000;
+
+	while ((opt = getopt(argc, argv, "b:w:f:s:ro:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'w':
+			name = optarg;
+			break;
+		case 'f':
+			ctx.frames = atoi(optarg);
+			break;
+		case 's':
+			ctx.stall_ns = atoll(optarg) * 1000;
+			break;
+		case 'r':
+			ctx.realtime = 1;
+			break;
+		case 'o':
+			fp = fopen(optarg, "w");
+			if (!fp) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage_exit(argv[0]);
+			break;
+		}
+	}
+
+	if (ctx.frames <= 0 || ctx.stall_ns <= 0)
+		usage_exit(argv[0]);
+
+	if (name) {
+		for (i = 0; i < ARRAY_SIZE(workloads); i++) {
+			if (!strcmp(workloads[i].name, name))
+				break;
+		}
+		if (i == ARRAY_SIZE(workloads))
+			usage_exit(argv[0]);
+	}
+
+	ctx.drm = bench_create_drm(backend);
+	if (!ctx.drm) {
+		fprintf(stderr, "failed to create the %s backend\n", backend);
+		return 1;
+	}
+
+	if (bench_samples_init(&ctx.frame_samples, ctx.frames) ||
+	    bench_samples_init(&ctx.alloc_samples,
+		    ctx.frames * MAX_BUFFERS))
+		return 1;
+
+	fprintf(fp, "{\n\"benchmark\": \"gralloc_drm_workload\",\n"
+			"\"backend\": \"%s\",\n\"realtime\": %s,\n"
+			"\"stall_ns\": %lld,\n\"results\": [\n", backend,
+			(ctx.realtime) ? "true" : "false",
+			(long long) ctx.stall_ns);
+
+	for (i = 0; i < ARRAY_SIZE(workloads); i++) {
+		if (name && strcmp(workloads[i].name, name))
+			continue;
+
+		if (!first)
+			fprintf(fp, ",\n");
+		first = 0;
+
+		run_workload(&ctx, &workloads[i], fp);
+	}
+
+	fprintf(fp, "\n]\n}\n");
+
+	bench_samples_fini(&ctx.frame_samples);
+	bench_samples_fini(&ctx.alloc_samples);
+	gralloc_drm_destroy(ctx.drm);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Host stand-in of the cutils atomics, on the compiler builtins.  The
+ * compare-and-swaps return 0 on success, as on Android.
+ */
+
+#ifndef _HOST_CUTILS_ATOMIC_H_
+#define _HOST_CUTILS_ATOMIC_H_
+
+#include <stdint.h>
+
+static inline int32_t android_atomic_inc(volatile int32_t *addr)
+{
+	return __atomic_fetch_add(addr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t android_atomic_dec(volatile int32_t *addr)
+{
+	return __atomic_fetch_sub(addr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t android_atomic_add(int32_t value, volatile int32_t *addr)
+{
+	return __atomic_fetch_add(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t android_atomic_and(int32_t value, volatile int32_t *addr)
+{
+	return __atomic_fetch_and(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t android_atomic_or(int32_t value, volatile int32_t *addr)
+{
+	return __atomic_fetch_or(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t android_atomic_acquire_load(volatile const int32_t *addr)
+{
+	return __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+}
+
+static inline void android_atomic_release_store(int32_t value,
+		volatile int32_t *addr)
+{
+	__atomic_store_n(addr, value, __ATOMIC_RELEASE);
+}
+
+static inline void android_atomic_write(int32_t value, volatile int32_t *addr)
+{
+	__atomic_store_n(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int android_atomic_acquire_cas(int32_t old_value,
+		int32_t new_value, volatile int32_t *addr)
+{
+	return !__atomic_compare_exchange_n(addr, &old_value, new_value, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+static inline int android_atomic_release_cas(int32_t old_value,
+		int32_t new_value, volatile int32_t *addr)
+{
+	return !__atomic_compare_exchange_n(addr, &old_value, new_value, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static inline int android_atomic_cas(int32_t old_value, int32_t new_value,
+		volatile int32_t *addr)
+{
+	return !__atomic_compare_exchange_n(addr, &old_value, new_value, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif /* _HOST_CUTILS_ATOMIC_H_ */
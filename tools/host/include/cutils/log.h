@@ -0,0 +1 @@
+#include <log/log.h>
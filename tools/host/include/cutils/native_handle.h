@@ -0,0 +1,17 @@
+/*
+ * Host stand-in of the cutils native handles.
+ */
+
+#ifndef _HOST_CUTILS_NATIVE_HANDLE_H_
+#define _HOST_CUTILS_NATIVE_HANDLE_H_
+
+typedef struct native_handle {
+	int version;	/* sizeof(native_handle_t) */
+	int numFds;
+	int numInts;
+	int data[0];	/* numFds fds, then numInts ints */
+} native_handle_t;
+
+typedef const native_handle_t *buffer_handle_t;
+
+#endif /* _HOST_CUTILS_NATIVE_HANDLE_H_ */
@@ -0,0 +1,69 @@
+/*
+ * Host stand-in of the system properties: a property is read from the
+ * environment variable of the same name, so that
+ *
+ *   debug.gralloc.cache_size=0 ./gralloc_drm_bench -b soft
+ *
+ * works as setprop would on a device.
+ */
+
+#ifndef _HOST_CUTILS_PROPERTIES_H_
+#define _HOST_CUTILS_PROPERTIES_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PROPERTY_KEY_MAX 32
+#define PROPERTY_VALUE_MAX 92
+
+static inline int property_get(const char *key, char *value,
+		const char *default_value)
+{
+	const char *env = getenv(key);
+
+	if (!env)
+		env = (default_value) ? default_value : "";
+	strncpy(value, env, PROPERTY_VALUE_MAX - 1);
+	value[PROPERTY_VALUE_MAX - 1] = '\0';
+
+	return strlen(value);
+}
+
+static inline int64_t property_get_int64(const char *key,
+		int64_t default_value)
+{
+	const char *env = getenv(key);
+	char *end;
+	int64_t val;
+
+	if (!env || !*env)
+		return default_value;
+	val = strtoll(env, &end, 0);
+
+	return (*end) ? default_value : val;
+}
+
+static inline int32_t property_get_int32(const char *key,
+		int32_t default_value)
+{
+	return (int32_t) property_get_int64(key, default_value);
+}
+
+static inline int8_t property_get_bool(const char *key, int8_t default_value)
+{
+	const char *env = getenv(key);
+
+	if (!env)
+		return default_value;
+	if (!strcmp(env, "1") || !strcmp(env, "y") || !strcmp(env, "yes") ||
+	    !strcmp(env, "on") || !strcmp(env, "true"))
+		return 1;
+	if (!strcmp(env, "0") || !strcmp(env, "n") || !strcmp(env, "no") ||
+	    !strcmp(env, "off") || !strcmp(env, "false"))
+		return 0;
+
+	return default_value;
+}
+
+#endif /* _HOST_CUTILS_PROPERTIES_H_ */
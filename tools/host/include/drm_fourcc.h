@@ -0,0 +1,38 @@
+/*
+ * Host stand-in of the libdrm fourcc codes and modifiers the core uses.
+ */
+
+#ifndef _HOST_DRM_FOURCC_H_
+#define _HOST_DRM_FOURCC_H_
+
+#include <stdint.h>
+
+#define fourcc_code(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | \
+		((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+#define DRM_FORMAT_R8		fourcc_code('R', '8', ' ', ' ')
+#define DRM_FORMAT_RGB565	fourcc_code('R', 'G', '1', '6')
+#define DRM_FORMAT_BGR888	fourcc_code('B', 'G', '2', '4')
+#define DRM_FORMAT_ARGB8888	fourcc_code('A', 'R', '2', '4')
+#define DRM_FORMAT_XBGR8888	fourcc_code('X', 'B', '2', '4')
+#define DRM_FORMAT_ABGR8888	fourcc_code('A', 'B', '2', '4')
+#define DRM_FORMAT_ABGR2101010	fourcc_code('A', 'B', '3', '0')
+#define DRM_FORMAT_ABGR16161616F fourcc_code('A', 'B', '4', 'H')
+#define DRM_FORMAT_YUYV		fourcc_code('Y', 'U', 'Y', 'V')
+#define DRM_FORMAT_NV12		fourcc_code('N', 'V', '1', '2')
+#define DRM_FORMAT_NV21		fourcc_code('N', 'V', '2', '1')
+#define DRM_FORMAT_NV16		fourcc_code('N', 'V', '1', '6')
+#define DRM_FORMAT_P010		fourcc_code('P', '0', '1', '0')
+#define DRM_FORMAT_YVU420	fourcc_code('Y', 'V', '1', '2')
+
+#define fourcc_mod_code(vendor, val) \
+	((((uint64_t) (vendor)) << 56) | ((val) & 0x00ffffffffffffffULL))
+
+#define DRM_FORMAT_MOD_VENDOR_NONE 0
+#define DRM_FORMAT_RESERVED ((1ULL << 56) - 1)
+
+#define DRM_FORMAT_MOD_INVALID \
+	fourcc_mod_code(DRM_FORMAT_MOD_VENDOR_NONE, DRM_FORMAT_RESERVED)
+#define DRM_FORMAT_MOD_LINEAR fourcc_mod_code(DRM_FORMAT_MOD_VENDOR_NONE, 0)
+
+#endif /* _HOST_DRM_FOURCC_H_ */
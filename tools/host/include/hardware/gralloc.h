@@ -0,0 +1,94 @@
+/*
+ * Host stand-in of the gralloc 0.3 HAL interface.
+ */
+
+#ifndef _HOST_HARDWARE_GRALLOC_H_
+#define _HOST_HARDWARE_GRALLOC_H_
+
+#include <hardware/hardware.h>
+#include <system/graphics.h>
+#include <cutils/native_handle.h>
+
+#define GRALLOC_MODULE_API_VERSION_0_3 HARDWARE_MAKE_API_VERSION(0, 3)
+#define GRALLOC_HARDWARE_MODULE_ID "gralloc"
+#define GRALLOC_HARDWARE_GPU0 "gpu0"
+
+enum {
+	GRALLOC_USAGE_SW_READ_NEVER = 0x00000000,
+	GRALLOC_USAGE_SW_READ_RARELY = 0x00000002,
+	GRALLOC_USAGE_SW_READ_OFTEN = 0x00000003,
+	GRALLOC_USAGE_SW_READ_MASK = 0x0000000F,
+	GRALLOC_USAGE_SW_WRITE_NEVER = 0x00000000,
+	GRALLOC_USAGE_SW_WRITE_RARELY = 0x00000020,
+	GRALLOC_USAGE_SW_WRITE_OFTEN = 0x00000030,
+	GRALLOC_USAGE_SW_WRITE_MASK = 0x000000F0,
+	GRALLOC_USAGE_HW_TEXTURE = 0x00000100,
+	GRALLOC_USAGE_HW_RENDER = 0x00000200,
+	GRALLOC_USAGE_HW_2D = 0x00000400,
+	GRALLOC_USAGE_HW_COMPOSER = 0x00000800,
+	GRALLOC_USAGE_HW_FB = 0x00001000,
+	GRALLOC_USAGE_EXTERNAL_DISP = 0x00002000,
+	GRALLOC_USAGE_PROTECTED = 0x00004000,
+	GRALLOC_USAGE_CURSOR = 0x00008000,
+	GRALLOC_USAGE_HW_VIDEO_ENCODER = 0x00010000,
+	GRALLOC_USAGE_HW_CAMERA_WRITE = 0x00020000,
+	GRALLOC_USAGE_HW_CAMERA_READ = 0x00040000,
+	GRALLOC_USAGE_HW_CAMERA_ZSL = 0x00060000,
+	GRALLOC_USAGE_HW_CAMERA_MASK = 0x00060000,
+	GRALLOC_USAGE_HW_MASK = 0x00071F00,
+	GRALLOC_USAGE_RENDERSCRIPT = 0x00100000,
+};
+
+typedef struct gralloc_module_t {
+	struct hw_module_t common;
+
+	int (*registerBuffer)(struct gralloc_module_t const *module,
+			buffer_handle_t handle);
+	int (*unregisterBuffer)(struct gralloc_module_t const *module,
+			buffer_handle_t handle);
+	int (*lock)(struct gralloc_module_t const *module,
+			buffer_handle_t handle, int usage,
+			int l, int t, int w, int h, void **vaddr);
+	int (*unlock)(struct gralloc_module_t const *module,
+			buffer_handle_t handle);
+	int (*perform)(struct gralloc_module_t const *module,
+			int operation, ...);
+	int (*lock_ycbcr)(struct gralloc_module_t const *module,
+			buffer_handle_t handle, int usage,
+			int l, int t, int w, int h,
+			struct android_ycbcr *ycbcr);
+	int (*lockAsync)(struct gralloc_module_t const *module,
+			buffer_handle_t handle, int usage,
+			int l, int t, int w, int h, void **vaddr, int fence_fd);
+	int (*unlockAsync)(struct gralloc_module_t const *module,
+			buffer_handle_t handle, int *fence_fd);
+	int (*lockAsync_ycbcr)(struct gralloc_module_t const *module,
+			buffer_handle_t handle, int usage,
+			int l, int t, int w, int h,
+			struct android_ycbcr *ycbcr, int fence_fd);
+	void *reserved_proc[3];
+} gralloc_module_t;
+
+typedef struct alloc_device_t {
+	struct hw_device_t common;
+
+	int (*alloc)(struct alloc_device_t *dev, int w, int h, int format,
+			int usage, buffer_handle_t *handle, int *stride);
+	int (*free)(struct alloc_device_t *dev, buffer_handle_t handle);
+	void (*dump)(struct alloc_device_t *dev, char *buff, int buff_len);
+	void *reserved_proc[7];
+} alloc_device_t;
+
+static inline int gralloc_open(const struct hw_module_t *module,
+		struct alloc_device_t **device)
+{
+	return module->methods->open(module, GRALLOC_HARDWARE_GPU0,
+			(struct hw_device_t **) device);
+}
+
+static inline int gralloc_close(struct alloc_device_t *device)
+{
+	return device->common.close(&device->common);
+}
+
+#endif /* _HOST_HARDWARE_GRALLOC_H_ */
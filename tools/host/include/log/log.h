@@ -0,0 +1,26 @@
+/*
+ * Host stand-in of liblog: messages go to stderr.
+ */
+
+#ifndef _HOST_LOG_LOG_H_
+#define _HOST_LOG_LOG_H_
+
+#include <stdio.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+#define __host_log(level, ...) do { \
+	fprintf(stderr, "%s %s: ", level, (LOG_TAG) ? (LOG_TAG) : ""); \
+	fprintf(stderr, __VA_ARGS__); \
+	fputc('\n', stderr); \
+} while (0)
+
+#define ALOGE(...) __host_log("E", __VA_ARGS__)
+#define ALOGW(...) __host_log("W", __VA_ARGS__)
+#define ALOGI(...) __host_log("I", __VA_ARGS__)
+#define ALOGD(...) __host_log("D", __VA_ARGS__)
+#define ALOGV(...) do { } while (0)
+
+#endif /* _HOST_LOG_LOG_H_ */
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in of libsync, see tools/host/stubs.c.
+ */
+
+#ifndef _HOST_SYNC_SYNC_H_
+#define _HOST_SYNC_SYNC_H_
+
+int sync_wait(int fd, int timeout);
+
+#endif /* _HOST_SYNC_SYNC_H_ */
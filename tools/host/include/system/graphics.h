@@ -0,0 +1,39 @@
+/*
+ * Host stand-in of the HAL pixel formats, with the values of Android.
+ */
+
+#ifndef _HOST_SYSTEM_GRAPHICS_H_
+#define _HOST_SYSTEM_GRAPHICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum {
+	HAL_PIXEL_FORMAT_RGBA_8888 = 1,
+	HAL_PIXEL_FORMAT_RGBX_8888 = 2,
+	HAL_PIXEL_FORMAT_RGB_888 = 3,
+	HAL_PIXEL_FORMAT_RGB_565 = 4,
+	HAL_PIXEL_FORMAT_BGRA_8888 = 5,
+	HAL_PIXEL_FORMAT_YCbCr_422_SP = 0x10,
+	HAL_PIXEL_FORMAT_YCrCb_420_SP = 0x11,
+	HAL_PIXEL_FORMAT_YCbCr_422_I = 0x14,
+	HAL_PIXEL_FORMAT_RGBA_FP16 = 0x16,
+	HAL_PIXEL_FORMAT_BLOB = 0x21,
+	HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED = 0x22,
+	HAL_PIXEL_FORMAT_YCbCr_420_888 = 0x23,
+	HAL_PIXEL_FORMAT_RGBA_1010102 = 0x2B,
+	HAL_PIXEL_FORMAT_YCBCR_P010 = 0x36,
+	HAL_PIXEL_FORMAT_YV12 = 0x32315659,
+};
+
+struct android_ycbcr {
+	void *y;
+	void *cb;
+	void *cr;
+	size_t ystride;
+	size_t cstride;
+	size_t chroma_step;
+	uint32_t reserved[8];
+};
+
+#endif /* _HOST_SYSTEM_GRAPHICS_H_ */
@@ -0,0 +1,72 @@
+/*
+ * Host stand-in of the libdrm calls and the KMS dumb buffer ioctls the
+ * core uses.  There is no DRM device on the host: the calls fail, see
+ * tools/host/stubs.c.
+ */
+
+#ifndef _HOST_XF86DRM_H_
+#define _HOST_XF86DRM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+
+#define DRM_NODE_PRIMARY 0
+#define DRM_NODE_CONTROL 1
+#define DRM_NODE_RENDER 2
+
+#define DRM_RDWR 02 /* O_RDWR */
+#define DRM_CLOEXEC 02000000 /* O_CLOEXEC */
+
+#define DRM_CAP_DUMB_BUFFER 0x1
+
+struct drm_mode_create_dumb {
+	uint32_t height;
+	uint32_t width;
+	uint32_t bpp;
+	uint32_t flags;
+	uint32_t handle;
+	uint32_t pitch;
+	uint64_t size;
+};
+
+struct drm_mode_map_dumb {
+	uint32_t handle;
+	uint32_t pad;
+	uint64_t offset;
+};
+
+struct drm_mode_destroy_dumb {
+	uint32_t handle;
+};
+
+#define DRM_IOCTL_BASE 'd'
+#define DRM_IOCTL_MODE_CREATE_DUMB \
+	_IOWR(DRM_IOCTL_BASE, 0xB2, struct drm_mode_create_dumb)
+#define DRM_IOCTL_MODE_MAP_DUMB \
+	_IOWR(DRM_IOCTL_BASE, 0xB3, struct drm_mode_map_dumb)
+#define DRM_IOCTL_MODE_DESTROY_DUMB \
+	_IOWR(DRM_IOCTL_BASE, 0xB4, struct drm_mode_destroy_dumb)
+
+typedef struct _drmVersion {
+	int version_major;
+	int version_minor;
+	int version_patchlevel;
+	int name_len;
+	char *name;
+	int date_len;
+	char *date;
+	int desc_len;
+	char *desc;
+} drmVersion, *drmVersionPtr;
+
+drmVersionPtr drmGetVersion(int fd);
+void drmFreeVersion(drmVersionPtr version);
+int drmGetCap(int fd, uint64_t capability, uint64_t *value);
+int drmGetNodeTypeFromFd(int fd);
+char *drmGetPrimaryDeviceNameFromFd(int fd);
+int drmIoctl(int fd, unsigned long request, void *arg);
+int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int *prime_fd);
+int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle);
+
+#endif /* _HOST_XF86DRM_H_ */
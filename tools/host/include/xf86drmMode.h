@@ -0,0 +1,10 @@
+/*
+ * Host stand-in of libdrm's KMS interface, which the core does not call.
+ */
+
+#ifndef _HOST_XF86DRMMODE_H_
+#define _HOST_XF86DRMMODE_H_
+
+#include <xf86drm.h>
+
+#endif /* _HOST_XF86DRMMODE_H_ */
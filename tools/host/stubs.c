@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The Android libraries the tools link against, for a host build without
+ * a device.  There is no DRM device, no fence and no HAL module on the
+ * host, so only the software driver ("-b soft") runs.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <xf86drm.h>
+#include <sync/sync.h>
+#include <hardware/hardware.h>
+
+/* the software driver signals no fences */
+int sync_wait(int fd, int timeout)
+{
+	return 0;
+}
+
+drmVersionPtr drmGetVersion(int fd)
+{
+	return NULL;
+}
+
+void drmFreeVersion(drmVersionPtr version)
+{
+}
+
+int drmGetCap(int fd, uint64_t capability, uint64_t *value)
+{
+	return -ENODEV;
+}
+
+int drmGetNodeTypeFromFd(int fd)
+{
+	return -ENODEV;
+}
+
+char *drmGetPrimaryDeviceNameFromFd(int fd)
+{
+	return NULL;
+}
+
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	errno = ENODEV;
+	return -1;
+}
+
+int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int *prime_fd)
+{
+	return -ENODEV;
+}
+
+int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle)
+{
+	return -ENODEV;
+}
+
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+	return -ENOENT;
+}
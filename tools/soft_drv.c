@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2026 The gralloc_drm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A software driver for the benchmarks.  Bos are memfds, so that handles
+ * can be imported like prime fds, and no DRM device is needed.
+ */
+
+#define LOG_TAG "GRALLOC-SOFT"
+
+#include <log/log.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+struct soft_buffer {
+	struct gralloc_drm_bo_t base;
+
+	void *ptr;
+};
+
+static void soft_destroy(struct gralloc_drm_drv_t *drv)
+{
+	free(drv);
+}
+
+/* compute the pitch and the size of a handle */
+static int soft_get_layout(const struct gralloc_drm_handle_t *handle,
+		int *pitch, size_t *size)
+{
+	int cpp, aligned_width, aligned_height;
+
+	cpp = gralloc_drm_get_bpp(handle->format);
+	if (!cpp)
+		return -EINVAL;
+
+	aligned_width = handle->width;
+	aligned_height = handle->height;
+	gralloc_drm_align_geometry(handle->format,
+			&aligned_width, &aligned_height);
+
+	*pitch = ALIGN(aligned_width * cpp, 64);
+	*size = (size_t) *pitch * aligned_height;
+
+	return 0;
+}
+
+static struct gralloc_drm_bo_t *soft_alloc(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_handle_t *handle)
+{
+	struct soft_buffer *buf;
+	size_t size;
+	int pitch;
+
+	if (soft_get_layout(handle, &pitch, &size))
+		return NULL;
+
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	if (handle->prime_fd >= 0) {
+		off_t end = lseek(handle->prime_fd, 0, SEEK_END);
+
+		if (end > 0)
+			size = (size_t) end;
+	}
+	else {
+		int fd;
+
+		/* round up so that the bo can be re-described */
+		size = gralloc_drm_size_class(size);
+
+		fd = syscall(SYS_memfd_create, "gralloc-soft", MFD_CLOEXEC);
+		if (fd < 0 || ftruncate(fd, size)) {
+			ALOGE("failed to create memfd of %zu bytes", size);
+			if (fd >= 0)
+				close(fd);
+			free(buf);
+			return NULL;
+		}
+
+		handle->prime_fd = fd;
+		handle->stride = pitch;
+	}
+
+	handle->name = 0;
+	buf->base.size = size;
+	buf->base.handle = handle;
+
+	return &buf->base;
+}
+
+static void soft_free(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	if (!bo->imported && bo->handle->prime_fd >= 0) {
+		close(bo->handle->prime_fd);
+		bo->handle->prime_fd = -1;
+	}
+
+	free(bo);
+}
+
+static int soft_map(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write, void **addr)
+{
+	struct soft_buffer *buf = (struct soft_buffer *) bo;
+	void *ptr;
+
+	ptr = mmap(NULL, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			bo->handle->prime_fd, 0);
+	if (ptr == MAP_FAILED)
+		return -errno;
+
+	buf->ptr = ptr;
+	*addr = ptr;
+
+	return 0;
+}
+
+static void soft_unmap(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo)
+{
+	struct soft_buffer *buf = (struct soft_buffer *) bo;
+
+	munmap(buf->ptr, bo->size);
+	buf->ptr = NULL;
+}
+
+static int soft_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write)
+{
+	return 0;
+}
+
+static int soft_redescribe(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		struct gralloc_drm_handle_t *handle)
+{
+	size_t size;
+	int pitch;
+
+	if (soft_get_layout(handle, &pitch, &size) ||
+	    !gralloc_drm_size_class_match(size, bo->size))
+		return -EINVAL;
+
+	handle->stride = pitch;
+	bo->handle = handle;
+
+	return 0;
+}
+
+struct gralloc_drm_drv_t *bench_create_soft_drv(void)
+{
+	struct gralloc_drm_drv_t *drv;
+
+	drv = calloc(1, sizeof(*drv));
+	if (!drv)
+		return NULL;
+
+	drv->destroy = soft_destroy;
+	drv->alloc = soft_alloc;
+	drv->free = soft_free;
+	drv->map = soft_map;
+	drv->unmap = soft_unmap;
+	drv->begin_cpu_access = soft_begin_cpu_access;
+	drv->redescribe = soft_redescribe;
+	drv->prime_mappable = 1;
+
+	return drv;
+}